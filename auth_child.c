@@ -22,6 +22,7 @@ limitations under the License.
 
 #include "env_settings.h"      // for GetIntSetting
 #include "logging.h"           // for LogErrno, Log
+#include "session_log.h"       // for CountSessionEvent, SessionAuth...
 #include "wait_pgrp.h"         // for KillPgrp, WaitPgrp
 #include "xscreensaver_api.h"  // for ExportWindowID
 
@@ -105,8 +106,10 @@ int WatchAuthChild(Window w, const char *executable, int force_auth,
       // Handle success; this will exit the screen lock.
       if (status == 0) {
         *auth_running = 0;
+        SessionAuthenticated();
         return 1;
       }
+      CountSessionEvent(SESSION_AUTH_UNSUCCESSFUL);
 
       // To handle failure, we just fall through, as we may want to immediately
       // launch a new auth child and send it a keypress.
@@ -145,6 +148,7 @@ int WatchAuthChild(Window w, const char *executable, int force_auth,
         close(pc[0]);
         auth_child_fd = pc[1];
         auth_child_pid = pid;
+        CountSessionEvent(SESSION_WAKE);
 
         if (stdinbuf != NULL &&
             (DiscardFirstKeypress() || !ContainsNonControl(stdinbuf))) {
@@ -28,6 +28,8 @@ all_settings=$(
 # List of internal settings. These shall not be documented.
 internal_settings='
 XSECURELOCK_INSIDE_SAVER_MULTIPLEX
+XSECURELOCK_PRESTAGE_FD
+XSECURELOCK_SUPERVISOR_SPARE
 '
 
 # List of deprecated settings. These shall not be documented.
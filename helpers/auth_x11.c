@@ -251,6 +251,9 @@ static int single_auth_window = 0;
 //! If set, we need to re-query monitor data and adjust windows.
 int per_monitor_windows_dirty = 1;
 
+//! Pending monitor changes that have not settled yet.
+MonitorChangeSettle monitor_change_settle;
+
 #ifdef HAVE_XKB_EXT
 //! If set, we show Xkb keyboard layout name.
 int show_keyboard_layout = 1;
@@ -1351,10 +1354,14 @@ int Prompt(const char *msg, char **response, int echo) {
 
     // Handle X11 events that queued up.
     while (!done && XPending(display) && (XNextEvent(display, &priv.ev), 1)) {
-      if (IsMonitorChangeEvent(display, priv.ev.type)) {
-        per_monitor_windows_dirty = 1;
+      if (IsMonitorChangeEvent(display, &priv.ev)) {
+        NoteMonitorChange(&monitor_change_settle);
       }
     }
+    // Only relayout once per burst of changes.
+    if (MonitorChangeSettled(&monitor_change_settle)) {
+      per_monitor_windows_dirty = 1;
+    }
   }
 
   // priv contains password related data, so better clear it.
@@ -0,0 +1,815 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief Screen dimming effects.
+ *
+ *Shared by the dimmer and the idle manager.
+ */
+
+#include "dim_effects.h"
+
+#include <X11/X.h>      // for Window, Atom, CopyFromParent, GCForegr...
+#include <X11/Xatom.h>  // for XA_CARDINAL
+#include <X11/Xlib.h>   // for Display, XColor, XSetWindowAttributes
+#include <math.h>       // for pow, ceil, exp, frexp, nextafter, sqrt
+#include <stdint.h>     // for uint32_t
+#include <stdio.h>      // for NULL, snprintf
+#include <stdlib.h>     // for abort, calloc, free, malloc
+#include <string.h>     // for memset, memcpy, strcmp
+#include <sys/select.h>  // for select, FD_SET, FD_ZERO, fd_set
+#include <sys/time.h>   // for gettimeofday, timeval
+#include <time.h>       // for nanosleep, timespec
+
+#ifdef HAVE_XPRESENT_EXT
+#include <X11/extensions/Xpresent.h>  // for XPresentNotifyMSC, XPresentSel...
+#endif
+#ifdef HAVE_XRANDR_EXT
+#include <X11/extensions/Xrandr.h>  // for XRRGetScreenResourcesCurrent
+#include <X11/extensions/randr.h>   // for RR_DoubleScan, RR_Interlace
+#endif
+
+#include "../env_settings.h"   // for GetIntSetting, GetDoubleSetting, GetSt...
+#include "../logging.h"        // for Log
+#include "../util.h"           // for MicrosecondsSince
+#include "../wm_properties.h"  // for SetWMProperties
+
+// Get the entry of value index of the Bayer matrix for n = 2^power.
+void Bayer(int index, int power, int *x, int *y) {
+  // M_1 = [1].
+  if (power == 0) {
+    *x = 0;
+    *y = 0;
+    return;
+  }
+  // M_{2n} = [[4Mn 4M_n+2] [4M_n+3 4M_n+1]]
+  int subx, suby;
+  Bayer(index >> 2, power - 1, &subx, &suby);
+  int n = 1 << (power - 1);
+  switch (index & 3) {
+    case 0:
+      *x = subx;
+      *y = suby;
+      break;
+    case 1:
+      *x = subx + n;
+      *y = suby + n;
+      break;
+    case 2:
+      *x = subx + n;
+      *y = suby;
+      break;
+    case 3:
+      *x = subx;
+      *y = suby + n;
+      break;
+    default:
+      // Logically impossible, but clang-analyzer needs help here.
+      abort();
+      break;
+  }
+}
+
+int HaveCompositor(Display *display) {
+  char buf[64];
+  int buflen =
+      snprintf(buf, sizeof(buf), "_NET_WM_CM_S%d", (int)DefaultScreen(display));
+  if (buflen <= 0 || (size_t)buflen >= sizeof(buf)) {
+    Log("Wow, pretty long screen number you got there");
+    return 0;
+  }
+  Atom atom = XInternAtom(display, buf, False);
+  return XGetSelectionOwner(display, atom) != None;
+}
+
+int dim_time_ms;
+int wait_time_ms;
+double dim_fps;
+double dim_alpha;
+
+XColor dim_color;
+
+int dim_present_opcode;
+
+//! Maximum number of bytes of stipple bitmaps to prepare on the X server.
+#define MAX_ATLAS_BYTES (4 << 20)
+
+//! Largest blue noise pattern we compute; bigger ones take too long to make.
+#define MAX_BLUE_NOISE_POWER 6
+
+struct DitherEffect {
+  struct DimEffect super;
+  int pattern_power;
+  int pattern_frames;
+  int max_fill_size;
+
+  //! The pixel to add to the pattern in each pattern frame.
+  XPoint *pattern_points;
+
+  // Number of pattern frames already drawn into the pattern.
+  int drawn_pframes;
+
+  //! One GC per display frame with the stipple of that frame, or NULL.
+  GC *atlas_gcs;
+
+  // Only used without the atlas: the pattern is built up incrementally.
+  Pixmap pattern;
+  XGCValues gc_values;
+  GC dim_gc, pattern_gc;
+};
+
+/*! \brief Adds a kernel centered at p to the energy of all pixels.
+ *
+ * The pattern wraps around, so distances are computed on a torus.
+ */
+static void AddEnergy(double *energy, const double *kernel, int power, int p,
+                      double sign) {
+  int n = 1 << power;
+  int px = p & (n - 1), py = p >> power;
+  for (int y = 0; y < n; ++y) {
+    const double *row = kernel + (((y - py) & (n - 1)) << power);
+    for (int x = 0; x < n; ++x) {
+      energy[(y << power) + x] += sign * row[(x - px) & (n - 1)];
+    }
+  }
+}
+
+/*! \brief Finds the pixel with extreme energy among those with pattern value.
+ *
+ * The pattern must contain at least one pixel with that value.
+ *
+ * \return The pixel with maximum energy if want_max, otherwise with minimum.
+ */
+static int FindExtreme(const char *pattern, const double *energy,
+                       size_t size, char value, int want_max) {
+  int best = 0, found = 0;
+  for (int p = 0; p < (int)size; ++p) {
+    if (pattern[p] != value) {
+      continue;
+    }
+    if (!found || (want_max ? energy[p] > energy[best]
+                            : energy[p] < energy[best])) {
+      best = p;
+      found = 1;
+    }
+  }
+  return best;
+}
+
+/*! \brief Computes the order of pixels of a blue noise threshold matrix.
+ *
+ * Uses Ulichney's void-and-cluster method. This is quadratic in the number of
+ * pixels, but only runs once per dimmer start.
+ *
+ * \param power The pattern is 2^power pixels wide and high.
+ * \param points Receives the pixel to turn on in each pattern frame.
+ */
+static void BlueNoise(int power, XPoint *points) {
+  int n = 1 << power;
+  size_t size = (size_t)n * n;
+  double *kernel = malloc(size * sizeof(double));
+  double *energy = calloc(size, sizeof(double));
+  double *initial_energy = malloc(size * sizeof(double));
+  char *pattern = calloc(size, 1);
+  char *initial_pattern = malloc(size);
+  int *rank = malloc(size * sizeof(int));
+  if (kernel == NULL || energy == NULL || initial_energy == NULL ||
+      pattern == NULL || initial_pattern == NULL || rank == NULL) {
+    Log("Out of memory computing blue noise - using Bayer dithering");
+    for (size_t i = 0; i < size; ++i) {
+      int x, y;
+      Bayer(i, power, &x, &y);
+      points[i].x = x;
+      points[i].y = y;
+    }
+    goto done;
+  }
+
+  // Gaussian kernel with sigma 1.5, as recommended by Ulichney.
+  for (int y = 0; y < n; ++y) {
+    int dy = y < n - y ? y : n - y;
+    for (int x = 0; x < n; ++x) {
+      int dx = x < n - x ? x : n - x;
+      kernel[(y << power) + x] = exp(-(dx * dx + dy * dy) / (2 * 1.5 * 1.5));
+    }
+  }
+
+  // Start with a deterministic pseudo-random tenth of the pixels set...
+  int ones = 0;
+  uint32_t seed = 1;
+  while ((size_t)ones < size / 10 + 1) {
+    seed = seed * 1103515245 + 12345;
+    size_t p = (seed >> 8) % size;
+    if (!pattern[p]) {
+      pattern[p] = 1;
+      AddEnergy(energy, kernel, power, p, 1);
+      ++ones;
+    }
+  }
+  // ... and spread them out by moving the tightest cluster to the largest void
+  // until that no longer changes anything.
+  for (size_t i = 0; i < size; ++i) {
+    int cluster = FindExtreme(pattern, energy, size, 1, 1);
+    pattern[cluster] = 0;
+    AddEnergy(energy, kernel, power, cluster, -1);
+    int hole = FindExtreme(pattern, energy, size, 0, 0);
+    pattern[hole] = 1;
+    AddEnergy(energy, kernel, power, hole, 1);
+    if (hole == cluster) {
+      break;
+    }
+  }
+  memcpy(initial_pattern, pattern, size);
+  memcpy(initial_energy, energy, size * sizeof(double));
+
+  // The initial pixels get ranked by removing the tightest clusters first...
+  for (int r = ones - 1; r >= 0; --r) {
+    int cluster = FindExtreme(pattern, energy, size, 1, 1);
+    pattern[cluster] = 0;
+    AddEnergy(energy, kernel, power, cluster, -1);
+    rank[cluster] = r;
+  }
+  memcpy(pattern, initial_pattern, size);
+  memcpy(energy, initial_energy, size * sizeof(double));
+
+  // ... the next ones up to half by filling the largest voids...
+  for (int r = ones; r < (int)size / 2; ++r) {
+    int hole = FindExtreme(pattern, energy, size, 0, 0);
+    pattern[hole] = 1;
+    AddEnergy(energy, kernel, power, hole, 1);
+    rank[hole] = r;
+  }
+
+  // ... and the rest by removing the tightest clusters of unset pixels.
+  memset(energy, 0, size * sizeof(double));
+  for (int p = 0; p < (int)size; ++p) {
+    if (!pattern[p]) {
+      AddEnergy(energy, kernel, power, p, 1);
+    }
+  }
+  for (int r = size / 2; r < (int)size; ++r) {
+    int cluster = FindExtreme(pattern, energy, size, 0, 1);
+    pattern[cluster] = 1;
+    AddEnergy(energy, kernel, power, cluster, -1);
+    rank[cluster] = r;
+  }
+
+  for (int p = 0; p < (int)size; ++p) {
+    points[rank[p]].x = p & (n - 1);
+    points[rank[p]].y = p >> power;
+  }
+
+done:
+  free(kernel);
+  free(energy);
+  free(initial_energy);
+  free(pattern);
+  free(initial_pattern);
+  free(rank);
+}
+
+/*! \brief Returns the number of pattern frames shown at the given frame.
+ *
+ * One display frame can have multiple pattern frames, and display frames may
+ * be skipped.
+ */
+static int EndPatternFrame(struct DitherEffect *dimmer, int frame) {
+  return (frame + 1) * dimmer->pattern_frames / dimmer->super.frame_count;
+}
+
+void DitherEffectPreCreateWindow(void *unused_self, Display *unused_display,
+                                 XSetWindowAttributes *unused_dimattrs,
+                                 unsigned long *unused_dimmask) {
+  (void)unused_self;
+  (void)unused_display;
+  (void)unused_dimattrs;
+  *unused_dimmask = *unused_dimmask;  // Shut up clang-analyzer.
+}
+
+void DitherEffectReset(void *self, Display *display,
+                       Window unused_dim_window) {
+  struct DitherEffect *dimmer = self;
+  (void)unused_dim_window;
+
+  // The window has no background, so once (re)mapped it starts out showing
+  // what is below it.
+  dimmer->drawn_pframes = 0;
+  if (dimmer->atlas_gcs != NULL) {
+    return;
+  }
+
+  // Clear the pattern.
+  XSetForeground(display, dimmer->pattern_gc, 0);
+  XFillRectangle(display, dimmer->pattern, dimmer->pattern_gc, 0, 0,
+                 1 << dimmer->pattern_power, 1 << dimmer->pattern_power);
+  XSetForeground(display, dimmer->pattern_gc, 1);
+}
+
+/*! \brief Prepares one stippled GC per display frame on the X server.
+ *
+ * Then drawing a frame is just a fill; changing the stipple of a GC would make
+ * the X server revalidate it on every frame.
+ *
+ * \return Whether the atlas was created.
+ */
+static int CreateAtlas(struct DitherEffect *dimmer, Display *display,
+                       Window dim_window) {
+  int n = 1 << dimmer->pattern_power;
+  int row_bytes = (n + 7) / 8;
+  if ((double)dimmer->super.frame_count * row_bytes * n > MAX_ATLAS_BYTES) {
+    return 0;
+  }
+  char *bits = calloc(row_bytes * n, 1);
+  dimmer->atlas_gcs = malloc(dimmer->super.frame_count * sizeof(GC));
+  if (bits == NULL || dimmer->atlas_gcs == NULL) {
+    free(bits);
+    free(dimmer->atlas_gcs);
+    dimmer->atlas_gcs = NULL;
+    return 0;
+  }
+  XGCValues gc_values;
+  gc_values.fill_style = FillStippled;
+  gc_values.foreground = dim_color.pixel;
+  int pframe = 0;
+  for (int frame = 0; frame < dimmer->super.frame_count; ++frame) {
+    for (int end = EndPatternFrame(dimmer, frame); pframe < end; ++pframe) {
+      const XPoint *point = &dimmer->pattern_points[pframe];
+      bits[point->y * row_bytes + point->x / 8] |= 1 << (point->x % 8);
+    }
+    gc_values.stipple =
+        XCreateBitmapFromData(display, dim_window, bits, n, n);
+    dimmer->atlas_gcs[frame] =
+        XCreateGC(display, dim_window, GCFillStyle | GCForeground | GCStipple,
+                  &gc_values);
+    // The GC keeps the stipple alive.
+    XFreePixmap(display, gc_values.stipple);
+  }
+  free(bits);
+  return 1;
+}
+
+void DitherEffectPostCreateWindow(void *self, Display *display,
+                                  Window dim_window) {
+  struct DitherEffect *dimmer = self;
+
+  if (CreateAtlas(dimmer, display, dim_window)) {
+    dimmer->drawn_pframes = 0;
+    return;
+  }
+
+  // Create a pixmap to define the pattern we want to set as the window shape.
+  dimmer->gc_values.foreground = 0;
+  dimmer->pattern =
+      XCreatePixmap(display, dim_window, 1 << dimmer->pattern_power,
+                    1 << dimmer->pattern_power, 1);
+  dimmer->pattern_gc =
+      XCreateGC(display, dimmer->pattern, GCForeground, &dimmer->gc_values);
+  DitherEffectReset(dimmer, display, dim_window);
+
+  // Create a pixmap to define the shape of the screen-filling window (which
+  // will increase over time).
+  dimmer->gc_values.fill_style = FillStippled;
+  dimmer->gc_values.foreground = dim_color.pixel;
+  dimmer->gc_values.stipple = dimmer->pattern;
+  dimmer->dim_gc =
+      XCreateGC(display, dim_window, GCFillStyle | GCForeground | GCStipple,
+                &dimmer->gc_values);
+}
+
+void DitherEffectDrawFrame(void *self, Display *display, Window dim_window,
+                           int frame, int w, int h) {
+  struct DitherEffect *dimmer = self;
+
+  // Move the pattern forward to the given display frame.
+  int end_pframe = EndPatternFrame(dimmer, frame);
+  if (end_pframe <= dimmer->drawn_pframes) {
+    // Nothing would change on screen.
+    return;
+  }
+  GC gc;
+  if (dimmer->atlas_gcs != NULL) {
+    gc = dimmer->atlas_gcs[frame];
+  } else {
+    XDrawPoints(display, dimmer->pattern, dimmer->pattern_gc,
+                dimmer->pattern_points + dimmer->drawn_pframes,
+                end_pframe - dimmer->drawn_pframes, CoordModeOrigin);
+    XChangeGC(display, dimmer->dim_gc, GCStipple, &dimmer->gc_values);
+    gc = dimmer->dim_gc;
+  }
+  dimmer->drawn_pframes = end_pframe;
+
+  // Draw the pattern on the window, but do it in some sub-rectangles to be
+  // easier on the X server on large screens.
+  for (int y = 0; y < h; y += dimmer->max_fill_size) {
+    int hh = h - y;
+    if (hh > dimmer->max_fill_size) {
+      hh = dimmer->max_fill_size;
+    }
+    for (int x = 0; x < w; x += dimmer->max_fill_size) {
+      int ww = w - x;
+      if (ww > dimmer->max_fill_size) {
+        ww = dimmer->max_fill_size;
+      }
+      XFillRectangle(display, dim_window, gc, x, y, ww, hh);
+      // We must flush here, or Xlib will coaelesce the rectangles to a single
+      // call, still keeping processing time per request on the X server
+      // potentially high.
+      XFlush(display);
+    }
+  }
+}
+
+void DitherEffectInit(struct DitherEffect *dimmer, Display *unused_display) {
+  (void)unused_display;
+
+  // Ensure dimming at least at a defined frame rate.
+  dimmer->pattern_power = 3;
+  // Total time of effect if we wouldn't stop after dim_alpha of fading out.
+  double total_time_ms = dim_time_ms / dim_alpha;
+  // Minimum "total" frame count of the animation.
+  double total_frames_min = total_time_ms / 1000.0 * dim_fps;
+  // This actually computes ceil(log2(sqrt(total_frames_min))) but cannot fail.
+  (void)frexp(sqrt(total_frames_min), &dimmer->pattern_power);
+  // Clip extreme/unsupported values.
+  if (dimmer->pattern_power < 2) {
+    dimmer->pattern_power = 2;
+  }
+  if (dimmer->pattern_power > 8) {
+    dimmer->pattern_power = 8;
+  }
+  const char *dither =
+      GetStringSetting("XSECURELOCK_DIM_DITHER_PATTERN", "bayer");
+  int blue_noise = !strcmp(dither, "blue_noise");
+  if (!blue_noise && strcmp(dither, "bayer")) {
+    Log("XSECURELOCK_DIM_DITHER_PATTERN not in bayer/blue_noise - using "
+        "bayer");
+  }
+  if (blue_noise && dimmer->pattern_power > MAX_BLUE_NOISE_POWER) {
+    dimmer->pattern_power = MAX_BLUE_NOISE_POWER;
+  }
+
+  // Precompute the order in which pixels get added to the pattern.
+  int pattern_size = 1 << (2 * dimmer->pattern_power);
+  dimmer->pattern_points = malloc(pattern_size * sizeof(XPoint));
+  if (dimmer->pattern_points == NULL) {
+    Log("Out of memory for the dither pattern");
+    abort();
+  }
+  if (blue_noise) {
+    BlueNoise(dimmer->pattern_power, dimmer->pattern_points);
+  } else {
+    for (int i = 0; i < pattern_size; ++i) {
+      int x, y;
+      Bayer(i, dimmer->pattern_power, &x, &y);
+      dimmer->pattern_points[i].x = x;
+      dimmer->pattern_points[i].y = y;
+    }
+  }
+
+  // Generate the frame count and vtable.
+  dimmer->pattern_frames = ceil(pow(1 << dimmer->pattern_power, 2) * dim_alpha);
+  dimmer->drawn_pframes = 0;
+  dimmer->atlas_gcs = NULL;
+  dimmer->super.frame_count = ceil(dim_time_ms * dim_fps / 1000.0);
+  // Limit the pattern fill size.
+  int max_fill_size = GetIntSetting("XSECURELOCK_DIM_MAX_FILL_SIZE", 2048);
+  int max_fill_patterns = max_fill_size >> dimmer->pattern_power;
+  if (max_fill_patterns == 0) {
+    max_fill_patterns = 1;
+  }
+  dimmer->max_fill_size = max_fill_patterns << dimmer->pattern_power;
+
+  dimmer->super.PreCreateWindow = DitherEffectPreCreateWindow;
+  dimmer->super.PostCreateWindow = DitherEffectPostCreateWindow;
+  dimmer->super.Reset = DitherEffectReset;
+  dimmer->super.DrawFrame = DitherEffectDrawFrame;
+}
+
+struct OpacityEffect {
+  struct DimEffect super;
+
+  Atom property_atom;
+  double dim_color_brightness;
+
+  // The most recently set opacity value, or -1 if none yet.
+  long last_value;
+};
+
+void OpacityEffectPreCreateWindow(void *unused_self, Display *unused_display,
+                                  XSetWindowAttributes *dimattrs,
+                                  unsigned long *dimmask) {
+  (void)unused_self;
+  (void)unused_display;
+
+  dimattrs->background_pixel = dim_color.pixel;
+  *dimmask |= CWBackPixel;
+}
+
+void OpacityEffectReset(void *self, Display *display, Window dim_window) {
+  struct OpacityEffect *dimmer = self;
+
+  long value = 0;
+  XChangeProperty(display, dim_window, dimmer->property_atom, XA_CARDINAL, 32,
+                  PropModeReplace, (unsigned char *)&value, 1);
+  dimmer->last_value = -1;
+}
+
+void OpacityEffectPostCreateWindow(void *self, Display *display,
+                                   Window dim_window) {
+  OpacityEffectReset(self, display, dim_window);
+}
+
+double sRGBToLinear(double value) {
+  return (value <= 0.04045) ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+}
+
+double LinearTosRGB(double value) {
+  return (value <= 0.0031308) ? 12.92 * value
+                              : 1.055 * pow(value, 1.0 / 2.4) - 0.055;
+}
+
+void OpacityEffectDrawFrame(void *self, Display *display, Window dim_window,
+                            int frame, int unused_w, int unused_h) {
+  struct OpacityEffect *dimmer = self;
+  (void)unused_w;
+  (void)unused_h;
+
+  // Calculate the linear-space alpha we want to be fading to.
+  double linear_alpha = (frame + 1) * dim_alpha / dimmer->super.frame_count;
+  double linear_min = linear_alpha * dimmer->dim_color_brightness;
+  double linear_max =
+      linear_alpha * dimmer->dim_color_brightness + (1.0 - linear_alpha);
+
+  // Calculate the sRGB-space alpha we thus must select to get the same color
+  // range.
+  double srgb_min = LinearTosRGB(linear_min);
+  double srgb_max = LinearTosRGB(linear_max);
+  double srgb_alpha = 1.0 - (srgb_max - srgb_min);
+  // Note: this may have a different brightness level, here we're simply
+  // solving for the same contrast as the "dither" mode.
+
+  // Log("Got: [%f..%f], want: [%f..%f]",
+  //     srgb_alpha * LinearTosRGB(dimmer->dim_color_brightness),
+  //     srgb_alpha * LinearTosRGB(dimmer->dim_color_brightness) +
+  //         (1.0 - srgb_alpha),
+  //     srgb_min, srgb_max);
+
+  // Convert to an opacity value.
+  long value = nextafter(0xffffffff, 0) * srgb_alpha;
+  if (dimmer->last_value >= 0 && (value >> 24) == (dimmer->last_value >> 24) &&
+      frame + 1 < dimmer->super.frame_count) {
+    // Compositors blend at 8 bits per channel, so this step is invisible.
+    return;
+  }
+  dimmer->last_value = value;
+  XChangeProperty(display, dim_window, dimmer->property_atom, XA_CARDINAL, 32,
+                  PropModeReplace, (unsigned char *)&value, 1);
+  // Make it actually visible.
+  XFlush(display);
+}
+
+void OpacityEffectInit(struct OpacityEffect *dimmer, Display *display) {
+  dimmer->property_atom = XInternAtom(display, "_NET_WM_WINDOW_OPACITY", False);
+  dimmer->dim_color_brightness =
+      sRGBToLinear(dim_color.red / 65535.0) * 0.2126 +
+      sRGBToLinear(dim_color.green / 65535.0) * 0.7152 +
+      sRGBToLinear(dim_color.blue / 65535.0) * 0.0722;
+  dimmer->last_value = -1;
+
+  // Generate the frame count and vtable.
+  dimmer->super.frame_count = ceil(dim_time_ms * dim_fps / 1000.0);
+  dimmer->super.PreCreateWindow = OpacityEffectPreCreateWindow;
+  dimmer->super.PostCreateWindow = OpacityEffectPostCreateWindow;
+  dimmer->super.Reset = OpacityEffectReset;
+  dimmer->super.DrawFrame = OpacityEffectDrawFrame;
+}
+
+#ifdef HAVE_XRANDR_EXT
+/*! \brief Returns the highest refresh rate of all active CRTCs.
+ *
+ * \return The refresh rate in Hz, or 0 if unknown.
+ */
+double GetRefreshRate(Display *display) {
+  int event_base, error_base, major, minor;
+  if (!XRRQueryExtension(display, &event_base, &error_base) ||
+      !XRRQueryVersion(display, &major, &minor) ||
+      (major == 1 && minor < 2)) {
+    return 0;
+  }
+  Window root_window = DefaultRootWindow(display);
+  // Avoid XRRGetScreenResources where possible, as it may reprobe outputs.
+  XRRScreenResources *screenres =
+      (major > 1 || minor >= 3) ? XRRGetScreenResourcesCurrent(display,
+                                                               root_window)
+                                : XRRGetScreenResources(display, root_window);
+  if (screenres == NULL) {
+    return 0;
+  }
+  double max_rate = 0;
+  for (int i = 0; i < screenres->ncrtc; ++i) {
+    XRRCrtcInfo *crtc = XRRGetCrtcInfo(display, screenres, screenres->crtcs[i]);
+    if (crtc == NULL) {
+      continue;
+    }
+    for (int j = 0; crtc->mode != None && j < screenres->nmode; ++j) {
+      const XRRModeInfo *mode = &screenres->modes[j];
+      if (mode->id != crtc->mode || mode->hTotal == 0 || mode->vTotal == 0) {
+        continue;
+      }
+      double v_total = mode->vTotal;
+      if (mode->modeFlags & RR_DoubleScan) {
+        v_total *= 2;
+      }
+      if (mode->modeFlags & RR_Interlace) {
+        v_total /= 2;
+      }
+      double rate = mode->dotClock / (mode->hTotal * v_total);
+      if (rate > max_rate) {
+        max_rate = rate;
+      }
+    }
+    XRRFreeCrtcInfo(crtc);
+  }
+  XRRFreeScreenResources(screenres);
+  return max_rate;
+}
+#endif
+
+#ifdef HAVE_XPRESENT_EXT
+int IsPresentCompleteEvent(Display *display, XEvent *ev, uint32_t serial) {
+  if (ev->type != GenericEvent || ev->xcookie.extension != dim_present_opcode ||
+      !XGetEventData(display, &ev->xcookie)) {
+    return 0;
+  }
+  int found = 0;
+  if (ev->xcookie.evtype == PresentCompleteNotify) {
+    XPresentCompleteNotifyEvent *complete = ev->xcookie.data;
+    found = complete->serial_number == serial;
+  }
+  XFreeEventData(display, &ev->xcookie);
+  return found;
+}
+
+/*! \brief Waits for the PresentCompleteNotify event of a NotifyMSC request.
+ *
+ * \return 1 if the event arrived, 0 on timeout.
+ */
+int WaitForPresentComplete(Display *display, uint32_t serial, int timeout_ms) {
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  int x11_fd = ConnectionNumber(display);
+  for (;;) {
+    while (XPending(display)) {
+      XEvent ev;
+      XNextEvent(display, &ev);
+      if (IsPresentCompleteEvent(display, &ev, serial)) {
+        return 1;
+      }
+    }
+    long long remaining_us =
+        timeout_ms * 1000LL - MicrosecondsSince(&start);
+    if (remaining_us <= 0) {
+      return 0;
+    }
+    fd_set in_fds;
+    memset(&in_fds, 0, sizeof(in_fds));  // For clang-analyzer.
+    FD_ZERO(&in_fds);
+    FD_SET(x11_fd, &in_fds);
+    struct timeval tv;
+    tv.tv_sec = remaining_us / 1000000;
+    tv.tv_usec = remaining_us % 1000000;
+    select(x11_fd + 1, &in_fds, 0, 0, &tv);
+  }
+}
+
+int RunDimEffectPresent(Display *display, struct DimEffect *dimmer,
+                        Window dim_window, int w, int h) {
+  XPresentSelectInput(display, dim_window, PresentCompleteNotifyMask);
+  // If no vertical blank arrives for this long, give up on Present.
+  int timeout_ms = 4000 / dim_fps + 100;
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  uint32_t serial = 0;
+  int next_frame = 0;
+  while (next_frame < dimmer->frame_count) {
+    // Wait for the next vertical blank.
+    XPresentNotifyMSC(display, dim_window, ++serial, 0, 1, 0);
+    XFlush(display);
+    if (!WaitForPresentComplete(display, serial, timeout_ms)) {
+      Log("No vertical blank notification received - falling back to timer");
+      return next_frame;
+    }
+    // Frame i is due at time i * dim_time_ms / frame_count, just like with the
+    // timer.
+    long long frame = MicrosecondsSince(&start) * dimmer->frame_count /
+                      (dim_time_ms * 1000LL);
+    if (frame < next_frame) {
+      continue;
+    }
+    if (frame >= dimmer->frame_count) {
+      frame = dimmer->frame_count - 1;
+    }
+    dimmer->DrawFrame(dimmer, display, dim_window, frame, w, h);
+    next_frame = frame + 1;
+  }
+  // Keep the last frame up for as long as the timer would have.
+  long long remaining_us = dim_time_ms * 1000LL - MicrosecondsSince(&start) +
+                           dim_time_ms * 1000LL / dimmer->frame_count;
+  if (remaining_us > 0) {
+    struct timespec sleep_ts;
+    sleep_ts.tv_sec = remaining_us / 1000000;
+    sleep_ts.tv_nsec = (remaining_us % 1000000) * 1000;
+    nanosleep(&sleep_ts, NULL);
+  }
+  return next_frame;
+}
+#endif
+
+void LoadDimSettings(Display *display) {
+  dim_time_ms = GetIntSetting("XSECURELOCK_DIM_TIME_MS", 2000);
+  wait_time_ms = GetIntSetting("XSECURELOCK_WAIT_TIME_MS", 5000);
+  dim_fps = GetDoubleSetting(
+      "XSECURELOCK_DIM_FPS",
+      GetDoubleSetting("XSECURELOCK_" /* REMOVE IN v2 */ "DIM_MIN_FPS", 60));
+  dim_alpha = GetDoubleSetting("XSECURELOCK_DIM_ALPHA", 0.875);
+
+  if (dim_alpha <= 0 || dim_alpha > 1) {
+    Log("XSECURELOCK_DIM_ALPHA must be in ]0..1] - using default");
+    dim_alpha = 0.875;
+  }
+
+  // If we can sync to vertical blank, there is no point in drawing more frames
+  // than the display can show.
+  dim_present_opcode = 0;
+#ifdef HAVE_XPRESENT_EXT
+  int present_event_base, present_error_base;
+  if (!XPresentQueryExtension(display, &dim_present_opcode, &present_event_base,
+                              &present_error_base)) {
+    dim_present_opcode = 0;
+  }
+#ifdef HAVE_XRANDR_EXT
+  if (dim_present_opcode != 0) {
+    double refresh_rate = GetRefreshRate(display);
+    if (refresh_rate > 0 && dim_fps > refresh_rate) {
+      dim_fps = refresh_rate;
+    }
+  }
+#endif
+#endif
+
+  // Prepare the background color.
+  Colormap colormap = DefaultColormap(display, DefaultScreen(display));
+  const char *color_name = GetStringSetting("XSECURELOCK_DIM_COLOR", "black");
+  XParseColor(display, colormap, color_name, &dim_color);
+  if (XAllocColor(display, colormap, &dim_color)) {
+    // Log("Allocated color %lu = %d %d %d", dim_color.pixel, dim_color.red,
+    //     dim_color.green, dim_color.blue);
+  } else {
+    dim_color.pixel = BlackPixel(display, DefaultScreen(display));
+    XQueryColor(display, colormap, &dim_color);
+    Log("Could not allocate color or unknown color name: %s", color_name);
+  }
+}
+
+struct DimEffect *InitDimEffect(Display *display) {
+  static struct DitherEffect dither_dimmer;
+  static struct OpacityEffect opacity_dimmer;
+  int have_compositor = GetIntSetting(
+      "XSECURELOCK_DIM_OVERRIDE_COMPOSITOR_DETECTION", HaveCompositor(display));
+  if (have_compositor) {
+    OpacityEffectInit(&opacity_dimmer, display);
+    return &opacity_dimmer.super;
+  }
+  DitherEffectInit(&dither_dimmer, display);
+  return &dither_dimmer.super;
+}
+
+Window CreateDimWindow(Display *display, struct DimEffect *dimmer, int w,
+                       int h, int argc, char **argv) {
+  XSetWindowAttributes dimattrs = {0};
+  dimattrs.save_under = 1;
+  dimattrs.override_redirect = 1;
+  unsigned long dimmask = CWSaveUnder | CWOverrideRedirect;
+  dimmer->PreCreateWindow(dimmer, display, &dimattrs, &dimmask);
+  Window dim_window = XCreateWindow(display, DefaultRootWindow(display), 0, 0,
+                                    w, h, 0, CopyFromParent, InputOutput,
+                                    CopyFromParent, dimmask, &dimattrs);
+  // Not using the xsecurelock WM_CLASS here as this window shouldn't prevent
+  // forcing grabs.
+  SetWMProperties(display, dim_window, "xsecurelock-dimmer", "dim", argc, argv);
+  dimmer->PostCreateWindow(dimmer, display, dim_window);
+  return dim_window;
+}
@@ -0,0 +1,84 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef DIM_EFFECTS_H
+#define DIM_EFFECTS_H
+
+#include <X11/X.h>     // for Window
+#include <X11/Xlib.h>  // for Display, XColor, XSetWindowAttributes
+#include <stdint.h>    // for uint32_t
+
+extern int dim_time_ms;
+extern int wait_time_ms;
+extern double dim_fps;
+extern double dim_alpha;
+
+extern XColor dim_color;
+
+//! The major opcode of the Present extension, or 0 if not available.
+extern int dim_present_opcode;
+
+struct DimEffect {
+  void (*PreCreateWindow)(void *self, Display *display,
+                          XSetWindowAttributes *dimattrs,
+                          unsigned long *dimmask);
+  void (*PostCreateWindow)(void *self, Display *display, Window dim_window);
+  void (*Reset)(void *self, Display *display, Window dim_window);
+  void (*DrawFrame)(void *self, Display *display, Window dim_window, int frame,
+                    int w, int h);
+
+  int frame_count;
+};
+
+/*! \brief Loads the dimming related settings, like XSECURELOCK_DIM_TIME_MS.
+ *
+ * Also allocates dim_color and detects the Present extension.
+ */
+void LoadDimSettings(Display *display);
+
+/*! \brief Picks and initializes the dim effect that suits the display.
+ *
+ * \return The dim effect; it is statically allocated.
+ */
+struct DimEffect *InitDimEffect(Display *display);
+
+/*! \brief Creates the (still unmapped) screen-filling window to dim on.
+ */
+Window CreateDimWindow(Display *display, struct DimEffect *dimmer, int w,
+                       int h, int argc, char **argv);
+
+#ifdef HAVE_XPRESENT_EXT
+/*! \brief Checks if an event is the PresentCompleteNotify for serial.
+ *
+ * Must be called right after XNextEvent, as it fetches the event data.
+ */
+int IsPresentCompleteEvent(Display *display, XEvent *ev, uint32_t serial);
+
+/*! \brief Runs the dim effect with frames paced by vertical blank.
+ *
+ * At most one frame is drawn per vertical blank; the frame to draw is derived
+ * from the elapsed time, so frames are skipped rather than delayed if the
+ * display refreshes slower than dim_fps.
+ *
+ * \return The index of the first frame that was not drawn yet. If this is
+ *   less than frame_count, the caller should continue with a timer, as vertical
+ *   blank events stopped arriving (e.g. because the display is off).
+ */
+int RunDimEffectPresent(Display *display, struct DimEffect *dimmer,
+                        Window dim_window, int w, int h);
+#endif
+
+#endif
@@ -0,0 +1,395 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ * \brief Idle manager.
+ *
+ * A resident replacement for running until_nonidle and dimmer from an idle
+ * watcher. It waits until the session is idle, dims the screen in-process,
+ * and then commits a locker that was pre-staged while dimming. Activity while
+ * dimming aborts the lock. Once the locker exits, it goes back to waiting.
+ *
+ * The X11 connection, idle timers and dim window are set up only once, so an
+ * idle cycle costs no process or connection setup except for the locker.
+ *
+ * Sample usage:
+ *   idle_manager xsecurelock
+ */
+
+#include <X11/X.h>       // for Window
+#include <X11/Xlib.h>    // for Display, XOpenDisplay, XMapRaised
+#include <signal.h>      // for sigprocmask, sigaddset, sigemptyset
+#include <stdint.h>      // for uint32_t, uint64_t
+#include <stdlib.h>      // for NULL, EXIT_FAILURE
+#include <string.h>      // for memset
+#include <sys/select.h>  // for pselect, FD_SET, FD_ZERO, fd_set
+#include <sys/time.h>    // for gettimeofday, timeval
+#include <time.h>        // for timespec
+#include <unistd.h>      // for _exit, close, execvp
+
+#ifdef HAVE_XPRESENT_EXT
+#include <X11/extensions/Xpresent.h>  // for XPresentNotifyMSC, XPresentSel...
+#endif
+
+#include "../env_settings.h"  // for GetIntSetting
+#include "../logging.h"       // for Log, LogErrno
+#include "../util.h"          // for MicrosecondsSince
+#include "../wait_pgrp.h"     // for KillPgrp, WaitPgrp, InitWaitPgrp
+#include "dim_effects.h"      // for DimEffect, LoadDimSettings, InitDimEffect
+#include "idle_timers.h"      // for GetIdleTime, CreateIdleTimeAlarms, ...
+#include "prestage.h"         // for CommitPrestagedLocker, StartPrestaged...
+
+//! How often to poll idle timers that we cannot get alarms for, in ms.
+#define IDLE_POLL_INTERVAL_MS 10
+
+enum IdleManagerState {
+  //! Waiting for the session to become idle; XSync alarms wake us up.
+  STATE_ACTIVE,
+  //! Dimming, or waiting in dimmed state; the locker is pre-staged.
+  STATE_DIMMING,
+  //! The locker is running.
+  STATE_LOCKED
+};
+
+Display *display;
+Window root_window;
+Window dim_window;
+struct DimEffect *dimmer;
+char **locker_argv;
+int idle_time_ms;
+
+enum IdleManagerState state = STATE_ACTIVE;
+pid_t lockerpid = 0;
+int prestage_fd = -1;
+
+// State of the current dim cycle.
+struct timeval dim_start;
+int dim_w, dim_h;
+int next_frame;
+uint64_t dim_prev_idle;
+int need_polling;
+int need_check;
+#ifdef HAVE_XPRESENT_EXT
+int use_present;
+uint32_t present_serial;
+struct timeval last_vblank;
+#endif
+
+/*! \brief Starts the locker without pre-staging, e.g. if pre-staging failed.
+ */
+void StartLocker(void) {
+  lockerpid = ForkWithoutSigHandlers();
+  if (lockerpid == -1) {
+    LogErrno("fork");
+    lockerpid = 0;
+    return;
+  }
+  if (lockerpid == 0) {
+    // Child process.
+    StartPgrp();
+    execvp(locker_argv[0], locker_argv);
+    LogErrno("execvp");
+    _exit(EXIT_FAILURE);
+  }
+}
+
+/*! \brief Reaps the locker if it exited.
+ */
+void WatchLocker(void) {
+  if (lockerpid == 0) {
+    return;
+  }
+  int status;
+  if (!WaitPgrp("locker", &lockerpid, 0, 0, &status)) {
+    return;
+  }
+  if (prestage_fd != -1) {
+    close(prestage_fd);
+    prestage_fd = -1;
+    if (state == STATE_DIMMING) {
+      Log("Locker exited before the lock was committed");
+    }
+  }
+  if (state == STATE_LOCKED) {
+    state = STATE_ACTIVE;
+  }
+}
+
+/*! \brief Starts a dim cycle.
+ *
+ * \param idle The idle time that made us start dimming.
+ */
+void StartDimming(uint64_t idle) {
+  // A locker from an aborted cycle may still be shutting down.
+  if (lockerpid != 0) {
+    int status;
+    WaitPgrp("locker", &lockerpid, 1, 0, &status);
+  }
+  prestage_fd = StartPrestagedLocker(locker_argv, &lockerpid);
+
+  // Follow root window size changes.
+  XWindowAttributes root_attrs;
+  XGetWindowAttributes(display, root_window, &root_attrs);
+  dim_w = root_attrs.width;
+  dim_h = root_attrs.height;
+  XMoveResizeWindow(display, dim_window, 0, 0, dim_w, dim_h);
+  dimmer->Reset(dimmer, display, dim_window);
+  XMapRaised(display, dim_window);
+
+  dim_prev_idle = idle;
+  need_polling = !CreateIdleAlarms(display);
+  // Activity may have happened before the alarms were set up.
+  need_check = 1;
+  gettimeofday(&dim_start, NULL);
+  next_frame = 0;
+#ifdef HAVE_XPRESENT_EXT
+  use_present = dim_present_opcode != 0;
+  if (use_present) {
+    XPresentNotifyMSC(display, dim_window, ++present_serial, 0, 1, 0);
+    last_vblank = dim_start;
+  }
+#endif
+  XFlush(display);
+  state = STATE_DIMMING;
+}
+
+void StopDimming(void) {
+  XUnmapWindow(display, dim_window);
+  DestroyIdleAlarms(display);
+  XFlush(display);
+}
+
+/*! \brief Draws the frame that is due at this time, if not drawn yet.
+ */
+void DrawDueFrame(void) {
+  if (next_frame >= dimmer->frame_count) {
+    return;
+  }
+  // Frame i is due at time i * dim_time_ms / frame_count.
+  long long frame = MicrosecondsSince(&dim_start) * dimmer->frame_count /
+                    (dim_time_ms * 1000LL);
+  if (frame < next_frame) {
+    return;
+  }
+  if (frame >= dimmer->frame_count) {
+    frame = dimmer->frame_count - 1;
+  }
+  dimmer->DrawFrame(dimmer, display, dim_window, frame, dim_w, dim_h);
+  next_frame = frame + 1;
+}
+
+/*! \brief Handles all pending X11 events.
+ *
+ * \return 1 if any of our idle alarms fired.
+ */
+int HandleEvents(void) {
+  int got_alarm = 0;
+  while (XPending(display)) {
+    XEvent ev;
+    XNextEvent(display, &ev);
+    if (IsIdleAlarmEvent(&ev)) {
+      got_alarm = 1;
+    }
+#ifdef HAVE_XPRESENT_EXT
+    if (state == STATE_DIMMING && use_present &&
+        IsPresentCompleteEvent(display, &ev, present_serial)) {
+      gettimeofday(&last_vblank, NULL);
+      DrawDueFrame();
+      if (next_frame < dimmer->frame_count) {
+        XPresentNotifyMSC(display, dim_window, ++present_serial, 0, 1, 0);
+      }
+    }
+#endif
+  }
+  return got_alarm;
+}
+
+/*! \brief Advances the state machine.
+ *
+ * \param got_alarm Whether an idle alarm fired since the last call.
+ * \return Milliseconds until the next call is needed, or -1 for no timeout.
+ */
+long Step(int got_alarm) {
+  switch (state) {
+    case STATE_ACTIVE: {
+      uint64_t idle = GetIdleTime(display, root_window);
+      if (idle < (uint64_t)idle_time_ms) {
+        if (CreateIdleTimeAlarms(display, idle_time_ms)) {
+          XFlush(display);
+          return -1;
+        }
+        // Idle time only increases without activity, so nothing can happen
+        // before this.
+        return idle_time_ms - (long)idle;
+      }
+      StartDimming(idle);
+      return 0;
+    }
+    case STATE_DIMMING: {
+      if (got_alarm || need_polling || need_check) {
+        uint64_t cur_idle = GetIdleTime(display, root_window);
+        int still_idle = cur_idle >= dim_prev_idle;
+        dim_prev_idle = cur_idle;
+        need_check = 0;
+        if (!still_idle) {
+          // Activity - abort the lock.
+          StopDimming();
+          if (prestage_fd != -1) {
+            close(prestage_fd);
+            prestage_fd = -1;
+          }
+          state = STATE_ACTIVE;
+          return 0;
+        }
+      }
+      long long elapsed_us = MicrosecondsSince(&dim_start);
+      if (elapsed_us >= (dim_time_ms + wait_time_ms) * 1000LL) {
+        // Keep dimming until the locker covers the screen.
+        if (prestage_fd == -1 || !CommitPrestagedLocker(prestage_fd)) {
+          if (lockerpid != 0) {
+            int status;
+            KillPgrp(lockerpid, SIGTERM);
+            WaitPgrp("locker", &lockerpid, 1, 1, &status);
+          }
+          StartLocker();
+        }
+        if (prestage_fd != -1) {
+          close(prestage_fd);
+          prestage_fd = -1;
+        }
+        StopDimming();
+        state = lockerpid != 0 ? STATE_LOCKED : STATE_ACTIVE;
+        return 0;
+      }
+      long long timeout_us = (dim_time_ms + wait_time_ms) * 1000LL - elapsed_us;
+#ifdef HAVE_XPRESENT_EXT
+      if (use_present && next_frame < dimmer->frame_count) {
+        // Frames get drawn on vertical blank. Fall back to the timer if
+        // vertical blank events stop arriving (e.g. display is off).
+        int present_timeout_ms = 4000 / dim_fps + 100;
+        long long since_vblank_us = MicrosecondsSince(&last_vblank);
+        if (since_vblank_us >= present_timeout_ms * 1000LL) {
+          Log("No vertical blank notification received - falling back to "
+              "timer");
+          use_present = 0;
+        } else if (present_timeout_ms * 1000LL - since_vblank_us <
+                   timeout_us) {
+          timeout_us = present_timeout_ms * 1000LL - since_vblank_us;
+        }
+      }
+      if (!use_present) {
+#endif
+        DrawDueFrame();
+        if (next_frame < dimmer->frame_count) {
+          long long due_us =
+              next_frame * (dim_time_ms * 1000LL) / dimmer->frame_count -
+              MicrosecondsSince(&dim_start);
+          if (due_us < timeout_us) {
+            timeout_us = due_us;
+          }
+        }
+#ifdef HAVE_XPRESENT_EXT
+      }
+#endif
+      XFlush(display);
+      if (need_polling && timeout_us > IDLE_POLL_INTERVAL_MS * 1000LL) {
+        timeout_us = IDLE_POLL_INTERVAL_MS * 1000LL;
+      }
+      // Round up so we do not wake up right before the deadline.
+      return timeout_us <= 0 ? 0 : (long)((timeout_us + 999) / 1000);
+    }
+    case STATE_LOCKED:
+      // Wait for the locker to exit.
+      return -1;
+  }
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  if (argc <= 1) {
+    Log("Usage: %s locker args... - dims the screen when idle, then locks",
+        argv[0]);
+    Log("Meant to be used with xsecurelock, like: %s xsecurelock", argv[0]);
+    return 1;
+  }
+  locker_argv = argv + 1;
+  idle_time_ms = GetIntSetting("XSECURELOCK_IDLE_TIME_MS", 600000);
+
+  display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    Log("Could not connect to $DISPLAY.");
+    return 1;
+  }
+  root_window = DefaultRootWindow(display);
+
+  // Look up the idle timers once.
+  if (InitIdleTimers(display) == 0) {
+    Log("Could not initialize idle timers. Bailing out.");
+    return 1;
+  }
+
+  // Prepare the dim effect and window once; they get reused for every cycle.
+  LoadDimSettings(display);
+  dimmer = InitDimEffect(display);
+  dim_window = CreateDimWindow(display, dimmer,
+                               DisplayWidth(display, DefaultScreen(display)),
+                               DisplayHeight(display, DefaultScreen(display)),
+                               argc, argv);
+#ifdef HAVE_XPRESENT_EXT
+  if (dim_present_opcode != 0) {
+    XPresentSelectInput(display, dim_window, PresentCompleteNotifyMask);
+  }
+#endif
+
+  InitWaitPgrp();
+
+  sigset_t sigchld_set, orig_set;
+  sigemptyset(&sigchld_set);
+  sigaddset(&sigchld_set, SIGCHLD);
+
+  int x11_fd = ConnectionNumber(display);
+  int got_alarm = 0;
+  for (;;) {
+    long timeout_ms = Step(got_alarm);
+
+    // Block SIGCHLD so the locker exiting after WatchLocker interrupts pselect.
+    sigprocmask(SIG_BLOCK, &sigchld_set, &orig_set);
+    enum IdleManagerState prev_state = state;
+    WatchLocker();
+    if (state == prev_state && timeout_ms != 0 && !XPending(display)) {
+      fd_set in_fds;
+      memset(&in_fds, 0, sizeof(in_fds));  // For clang-analyzer.
+      FD_ZERO(&in_fds);
+      FD_SET(x11_fd, &in_fds);
+      int max_fd = x11_fd;
+      if (prestage_fd != -1) {
+        // Readable when the locker exits.
+        FD_SET(prestage_fd, &in_fds);
+        if (prestage_fd > max_fd) {
+          max_fd = prestage_fd;
+        }
+      }
+      struct timespec timeout;
+      timeout.tv_sec = timeout_ms / 1000;
+      timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+      pselect(max_fd + 1, &in_fds, NULL, NULL, timeout_ms < 0 ? NULL : &timeout,
+              &orig_set);
+    }
+    sigprocmask(SIG_SETMASK, &orig_set, NULL);
+
+    got_alarm = HandleEvents();
+  }
+}
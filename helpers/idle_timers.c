@@ -0,0 +1,344 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief Idle time counters.
+ *
+ *Shared by until_nonidle and the idle manager.
+ */
+
+#include "idle_timers.h"
+
+#include <X11/X.h>     // for Window, None
+#include <X11/Xlib.h>  // for Display, XEvent
+#include <stdint.h>    // for uint64_t
+#include <stdlib.h>    // for NULL, size_t
+#include <string.h>    // for memcpy, strcmp, strcspn
+
+#ifdef HAVE_XSCREENSAVER_EXT
+#include <X11/extensions/scrnsaver.h>  // for XScreenSaverAllocInfo, XScreen...
+#endif
+
+#ifdef HAVE_XSYNC_EXT
+#include <X11/extensions/sync.h>       // for XSyncSystemCounter, XSyncListS...
+#include <X11/extensions/syncconst.h>  // for XSyncValue
+#endif
+
+#include "../env_settings.h"  // for GetStringSetting
+#include "../logging.h"       // for Log
+
+//! The maximum number of entries in XSECURELOCK_IDLE_TIMERS.
+#define MAX_IDLE_TIMERS 16
+
+#ifdef HAVE_XSCREENSAVER_EXT
+int have_xscreensaver_ext;
+XScreenSaverInfo *saver_info;
+#endif
+
+#ifdef HAVE_XSYNC_EXT
+int have_xsync_ext;
+int sync_event_base;
+#endif
+
+//! An idle timer from XSECURELOCK_IDLE_TIMERS, resolved once at startup.
+struct IdleTimer {
+  //! Whether to query the X11 Screen Saver extension's idle time.
+  int use_xscreensaver;
+#ifdef HAVE_XSYNC_EXT
+  //! The XSync counter to query, if not using the X11 Screen Saver extension.
+  XSyncCounter counter;
+  //! The XSync counter that resets along with this timer, or None.
+  XSyncCounter alarm_counter;
+  //! The alarm that fires when alarm_counter resets, or None.
+  XSyncAlarm alarm;
+#endif
+};
+
+struct IdleTimer idle_timers[MAX_IDLE_TIMERS];
+int num_idle_timers;
+
+#ifdef HAVE_XSYNC_EXT
+/*! \brief Looks up a system counter by name.
+ *
+ * \return The counter, or None if it does not exist.
+ */
+XSyncCounter FindSystemCounter(XSyncSystemCounter *counters, int num_counters,
+                               const char *name) {
+  for (int i = 0; i < num_counters; ++i) {
+    if (!strcmp(name, counters[i].name)) {
+      return counters[i].counter;
+    }
+  }
+  return None;
+}
+#endif
+
+/*! \brief Resolves a single timer name to an IdleTimer.
+ *
+ * \return 1 if the timer is supported, 0 otherwise.
+ */
+int ResolveIdleTimer(const char *timer, struct IdleTimer *out
+#ifdef HAVE_XSYNC_EXT
+                     ,
+                     XSyncSystemCounter *counters, int num_counters
+#endif
+) {
+  out->use_xscreensaver = 0;
+#ifdef HAVE_XSYNC_EXT
+  out->counter = None;
+  out->alarm_counter = None;
+  out->alarm = None;
+#endif
+  if (*timer == 0) {
+#ifdef HAVE_XSCREENSAVER_EXT
+    if (have_xscreensaver_ext) {
+      out->use_xscreensaver = 1;
+#ifdef HAVE_XSYNC_EXT
+      // The X11 Screen Saver extension's idle time resets on the same events
+      // as the IDLETIME counter, so we can use the latter for alarms.
+      if (have_xsync_ext) {
+        out->alarm_counter =
+            FindSystemCounter(counters, num_counters, "IDLETIME");
+      }
+#endif
+      return 1;
+    }
+#endif
+  } else {
+#ifdef HAVE_XSYNC_EXT
+    if (have_xsync_ext) {
+      out->counter = FindSystemCounter(counters, num_counters, timer);
+      if (out->counter != None) {
+        out->alarm_counter = out->counter;
+        return 1;
+      }
+    }
+#endif
+  }
+  Log("Timer \"%s\" not supported", timer);
+  return 0;
+}
+
+int InitIdleTimers(Display *display) {
+  const char *timers = GetStringSetting("XSECURELOCK_IDLE_TIMERS",
+#ifdef HAVE_XSCREENSAVER_EXT
+                                        ""
+#else
+                                        "IDLETIME"
+#endif
+  );
+
+  // Initialize the extensions.
+#ifdef HAVE_XSCREENSAVER_EXT
+  have_xscreensaver_ext = 0;
+  int scrnsaver_event_base, scrnsaver_error_base;
+  if (XScreenSaverQueryExtension(display, &scrnsaver_event_base,
+                                 &scrnsaver_error_base)) {
+    have_xscreensaver_ext = 1;
+    saver_info = XScreenSaverAllocInfo();
+  }
+#endif
+#ifdef HAVE_XSYNC_EXT
+  have_xsync_ext = 0;
+  int sync_error_base;
+  if (XSyncQueryExtension(display, &sync_event_base, &sync_error_base)) {
+    int major, minor;
+    have_xsync_ext = XSyncInitialize(display, &major, &minor);
+  }
+#endif
+
+#ifdef HAVE_XSYNC_EXT
+  int num_counters = 0;
+  XSyncSystemCounter *counters = NULL;
+  if (have_xsync_ext) {
+    counters = XSyncListSystemCounters(display, &num_counters);
+  }
+#else
+  (void)display;
+#endif
+  num_idle_timers = 0;
+  for (;;) {
+    size_t len = strcspn(timers, ",");
+    char this_timer[64];
+    if (len < sizeof(this_timer)) {
+      memcpy(this_timer, timers, len);
+      this_timer[len] = 0;
+      if (num_idle_timers >= MAX_IDLE_TIMERS) {
+        Log("Too many timers - skipping: %s", this_timer);
+      } else if (ResolveIdleTimer(this_timer, &idle_timers[num_idle_timers]
+#ifdef HAVE_XSYNC_EXT
+                                  ,
+                                  counters, num_counters
+#endif
+                                  )) {
+        ++num_idle_timers;
+      }
+    } else {
+      Log("Too long timer name - skipping: %s", timers);
+    }
+    if (timers[len] == 0) {  // End of string.
+      break;
+    }
+    timers += len + 1;
+  }
+#ifdef HAVE_XSYNC_EXT
+  if (counters != NULL) {
+    XSyncFreeSystemCounterList(counters);
+  }
+#endif
+  return num_idle_timers;
+}
+
+uint64_t GetIdleTimeForSingleTimer(Display *display, Window w,
+                                   const struct IdleTimer *timer) {
+#ifdef HAVE_XSCREENSAVER_EXT
+  if (timer->use_xscreensaver) {
+    XScreenSaverQueryInfo(display, w, saver_info);
+    return saver_info->idle;
+  }
+#endif
+#ifdef HAVE_XSYNC_EXT
+  if (timer->counter != None) {
+    XSyncValue value;
+    XSyncQueryCounter(display, timer->counter, &value);
+    return (((uint64_t)XSyncValueHigh32(value)) << 32) |
+           (uint64_t)XSyncValueLow32(value);
+  }
+#endif
+  (void)display;
+  (void)w;
+  (void)timer;
+  return (uint64_t)-1;
+}
+
+uint64_t GetIdleTime(Display *display, Window w) {
+  if (num_idle_timers == 0) {
+    return (uint64_t)-1;
+  }
+  uint64_t min_idle_time = (uint64_t)-1;
+  for (int i = 0; i < num_idle_timers; ++i) {
+    uint64_t this_idle_time =
+        GetIdleTimeForSingleTimer(display, w, &idle_timers[i]);
+    if (this_idle_time < min_idle_time) {
+      min_idle_time = this_idle_time;
+    }
+  }
+  return min_idle_time;
+}
+
+void DestroyIdleAlarms(Display *display) {
+#ifdef HAVE_XSYNC_EXT
+  for (int i = 0; i < num_idle_timers; ++i) {
+    if (idle_timers[i].alarm != None) {
+      XSyncDestroyAlarm(display, idle_timers[i].alarm);
+      idle_timers[i].alarm = None;
+    }
+  }
+#else
+  (void)display;
+#endif
+}
+
+#ifdef HAVE_XSYNC_EXT
+/*! \brief Creates the alarm of a timer.
+ *
+ * \param wait_value The value of alarm_counter to compare with.
+ * \param test_type How to compare, e.g. XSyncNegativeTransition.
+ */
+void CreateAlarm(Display *display, struct IdleTimer *timer,
+                 XSyncValue wait_value, XSyncTestType test_type) {
+  XSyncAlarmAttributes attrs;
+  attrs.trigger.counter = timer->alarm_counter;
+  attrs.trigger.value_type = XSyncAbsolute;
+  attrs.trigger.wait_value = wait_value;
+  attrs.trigger.test_type = test_type;
+  attrs.events = True;
+  timer->alarm = XSyncCreateAlarm(
+      display,
+      XSyncCACounter | XSyncCAValueType | XSyncCAValue | XSyncCATestType |
+          XSyncCAEvents,
+      &attrs);
+}
+#endif
+
+int CreateIdleAlarms(Display *display) {
+  DestroyIdleAlarms(display);
+  int have_all_alarms = 1;
+  for (int i = 0; i < num_idle_timers; ++i) {
+#ifdef HAVE_XSYNC_EXT
+    struct IdleTimer *timer = &idle_timers[i];
+    if (timer->alarm_counter != None) {
+      // Fire as soon as the counter goes below its current value, i.e. when it
+      // gets reset by user activity.
+      XSyncValue value;
+      XSyncQueryCounter(display, timer->alarm_counter, &value);
+      XSyncValue one;
+      XSyncIntToValue(&one, 1);
+      CreateAlarm(display, timer, XSyncValueLessThan(value, one) ? one : value,
+                  XSyncNegativeTransition);
+    }
+    if (timer->alarm == None) {
+      have_all_alarms = 0;
+    }
+#else
+    (void)display;
+    have_all_alarms = 0;
+#endif
+  }
+  return have_all_alarms;
+}
+
+int CreateIdleTimeAlarms(Display *display, uint64_t idle_ms) {
+  DestroyIdleAlarms(display);
+#ifdef HAVE_XSYNC_EXT
+  XSyncValue threshold;
+  XSyncIntsToValue(&threshold, (unsigned int)idle_ms, (int)(idle_ms >> 32));
+  int num_alarms = 0;
+  for (int i = 0; i < num_idle_timers; ++i) {
+    struct IdleTimer *timer = &idle_timers[i];
+    if (timer->alarm_counter == None) {
+      return 0;
+    }
+    XSyncValue value;
+    XSyncQueryCounter(display, timer->alarm_counter, &value);
+    if (!XSyncValueLessThan(value, threshold)) {
+      // Already idle long enough, so an alarm would fire right away. Should
+      // activity reset this timer, the alarms of the others still wake the
+      // caller up to check again.
+      continue;
+    }
+    CreateAlarm(display, timer, threshold, XSyncPositiveComparison);
+    if (timer->alarm == None) {
+      return 0;
+    }
+    ++num_alarms;
+  }
+  return num_alarms > 0;
+#else
+  (void)display;
+  (void)idle_ms;
+  return 0;
+#endif
+}
+
+int IsIdleAlarmEvent(const XEvent *ev) {
+#ifdef HAVE_XSYNC_EXT
+  return have_xsync_ext && ev->type == sync_event_base + XSyncAlarmNotify;
+#else
+  (void)ev;
+  return 0;
+#endif
+}
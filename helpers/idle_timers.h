@@ -0,0 +1,68 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef IDLE_TIMERS_H
+#define IDLE_TIMERS_H
+
+#include <X11/X.h>     // for Window
+#include <X11/Xlib.h>  // for Display, XEvent
+#include <stdint.h>    // for uint64_t
+
+/*! \brief Initializes the idle timers from XSECURELOCK_IDLE_TIMERS.
+ *
+ * The timers are resolved once, so the other functions do not need to look
+ * up counters by name again.
+ *
+ * \return The number of usable timers.
+ */
+int InitIdleTimers(Display *display);
+
+/*! \brief Returns the current idle time.
+ *
+ * If multiple timers are configured, this is the minimum of them all.
+ *
+ * \return The idle time, or (uint64_t)-1 if no timer is usable.
+ */
+uint64_t GetIdleTime(Display *display, Window w);
+
+/*! \brief Creates alarms that fire when the idle timers get reset.
+ *
+ * Any previously created alarms are destroyed first.
+ *
+ * \return 1 if all timers have alarms, 0 if some of them must be polled.
+ */
+int CreateIdleAlarms(Display *display);
+
+/*! \brief Creates alarms that fire once the idle time reaches idle_ms.
+ *
+ * Any previously created alarms are destroyed first. Timers that already
+ * reached idle_ms get no alarm, so none of the alarms fires right away.
+ *
+ * \return 1 if an alarm will fire once the idle time reaches idle_ms, 0 if
+ *   the caller must check by itself.
+ */
+int CreateIdleTimeAlarms(Display *display, uint64_t idle_ms);
+
+/*! \brief Destroys the alarms created by CreateIdleAlarms or
+ * CreateIdleTimeAlarms.
+ */
+void DestroyIdleAlarms(Display *display);
+
+/*! \brief Checks whether an event is one of our idle alarms firing.
+ */
+int IsIdleAlarmEvent(const XEvent *ev);
+
+#endif
@@ -0,0 +1,178 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "image_scale.h"
+
+#include <stdint.h>  // for uint16_t, uint32_t
+#include <stdlib.h>  // for free, malloc, calloc
+#include <string.h>  // for memset
+
+//! Precision of the filter weights; all weights of a pixel add up to 1 << it.
+#define WEIGHT_BITS 14
+
+//! The source pixels contributing to each destination pixel along one axis.
+struct Contributions {
+  //! First contributing source pixel, per destination pixel.
+  int *start;
+  //! Number of contributing source pixels, per destination pixel.
+  int *count;
+  //! The weights, max_count per destination pixel.
+  uint16_t *weights;
+  int max_count;
+};
+
+static void FreeContributions(struct Contributions *c) {
+  free(c->start);
+  free(c->count);
+  free(c->weights);
+}
+
+static int ComputeContributions(int src_size, int dst_size,
+                                struct Contributions *c) {
+  double scale = (double)src_size / dst_size;
+  c->max_count = (int)scale + 2;
+  c->start = malloc(dst_size * sizeof(*c->start));
+  c->count = malloc(dst_size * sizeof(*c->count));
+  c->weights = calloc((size_t)dst_size * c->max_count, sizeof(*c->weights));
+  if (c->start == NULL || c->count == NULL || c->weights == NULL) {
+    FreeContributions(c);
+    return -1;
+  }
+  for (int i = 0; i < dst_size; ++i) {
+    // The destination pixel covers [lo, hi) in source coordinates.
+    double lo = i * scale;
+    double hi = (i + 1) * scale;
+    int first = (int)lo;
+    int end = (int)hi;
+    if (end < hi) {
+      ++end;
+    }
+    if (end > src_size) {
+      end = src_size;
+    }
+    if (end > first + c->max_count) {
+      end = first + c->max_count;
+    }
+    if (end <= first) {
+      end = first + 1;
+    }
+    uint16_t *w = &c->weights[(size_t)i * c->max_count];
+    int sum = 0, largest = 0;
+    for (int j = first; j < end; ++j) {
+      double from = j > lo ? j : lo;
+      double to = j + 1 < hi ? j + 1 : hi;
+      int weight = (int)((to - from) / scale * (1 << WEIGHT_BITS) + 0.5);
+      if (weight < 0) {
+        weight = 0;
+      }
+      w[j - first] = weight;
+      sum += weight;
+      if (weight > w[largest]) {
+        largest = j - first;
+      }
+    }
+    // Make the weights add up exactly, so flat areas stay flat.
+    w[largest] += (1 << WEIGHT_BITS) - sum;
+    c->start[i] = first;
+    c->count[i] = end - first;
+  }
+  return 0;
+}
+
+void FitImageSize(int src_width, int src_height, int box_width, int box_height,
+                  int *width, int *height) {
+  if ((long long)src_width * box_height > (long long)src_height * box_width) {
+    *width = box_width;
+    *height = (int)((long long)src_height * box_width / src_width);
+  } else {
+    *width = (int)((long long)src_width * box_height / src_height);
+    *height = box_height;
+  }
+  if (*width < 1) {
+    *width = 1;
+  }
+  if (*height < 1) {
+    *height = 1;
+  }
+}
+
+int ScaleImageRGB(const unsigned char *src, int src_width, int src_height,
+                  uint32_t *dst, int dst_width, int dst_height,
+                  int dst_stride) {
+  struct Contributions h, v;
+  if (ComputeContributions(src_width, dst_width, &h)) {
+    return -1;
+  }
+  if (ComputeContributions(src_height, dst_height, &v)) {
+    FreeContributions(&h);
+    return -1;
+  }
+  size_t row_size = (size_t)dst_width * 3;
+  unsigned char *tmp = malloc(row_size * src_height);
+  uint32_t *acc = malloc(row_size * sizeof(*acc));
+  if (tmp == NULL || acc == NULL) {
+    free(tmp);
+    free(acc);
+    FreeContributions(&h);
+    FreeContributions(&v);
+    return -1;
+  }
+
+  // Horizontal pass: source rows to destination width.
+  for (int y = 0; y < src_height; ++y) {
+    const unsigned char *in = src + (size_t)y * src_width * 3;
+    unsigned char *out = tmp + (size_t)y * row_size;
+    for (int x = 0; x < dst_width; ++x) {
+      const unsigned char *p = in + (size_t)h.start[x] * 3;
+      const uint16_t *w = &h.weights[(size_t)x * h.max_count];
+      uint32_t r = 0, g = 0, b = 0;
+      for (int k = 0; k < h.count[x]; ++k) {
+        r += (uint32_t)w[k] * p[3 * k];
+        g += (uint32_t)w[k] * p[3 * k + 1];
+        b += (uint32_t)w[k] * p[3 * k + 2];
+      }
+      out[3 * x] = (r + (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS;
+      out[3 * x + 1] = (g + (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS;
+      out[3 * x + 2] = (b + (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS;
+    }
+  }
+
+  // Vertical pass: whole rows at once.
+  for (int y = 0; y < dst_height; ++y) {
+    memset(acc, 0, row_size * sizeof(*acc));
+    const uint16_t *w = &v.weights[(size_t)y * v.max_count];
+    for (int k = 0; k < v.count[y]; ++k) {
+      const unsigned char *in = tmp + (size_t)(v.start[y] + k) * row_size;
+      uint32_t weight = w[k];
+      for (size_t i = 0; i < row_size; ++i) {
+        acc[i] += weight * in[i];
+      }
+    }
+    uint32_t *out = dst + (size_t)y * dst_stride;
+    for (int x = 0; x < dst_width; ++x) {
+      uint32_t r = (acc[3 * x] + (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS;
+      uint32_t g = (acc[3 * x + 1] + (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS;
+      uint32_t b = (acc[3 * x + 2] + (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS;
+      out[x] = (r << 16) | (g << 8) | b;
+    }
+  }
+
+  free(tmp);
+  free(acc);
+  FreeContributions(&h);
+  FreeContributions(&v);
+  return 0;
+}
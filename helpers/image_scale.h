@@ -0,0 +1,47 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef IMAGE_SCALE_H
+#define IMAGE_SCALE_H
+
+#include <stdint.h>  // for uint32_t
+
+/*! \brief Computes the size of an image scaled to fit a box.
+ *
+ * The aspect ratio is kept; the result is at least 1x1.
+ */
+void FitImageSize(int src_width, int src_height, int box_width, int box_height,
+                  int *width, int *height);
+
+/*! \brief Scales an RGB image using an area averaging filter.
+ *
+ * The filter works in two separable passes with fixed point weights. The
+ * vertical pass runs over whole rows, so compilers can vectorize it.
+ *
+ * \param src The source pixels, 3 bytes (R, G, B) per pixel, without padding.
+ * \param src_width The source width.
+ * \param src_height The source height.
+ * \param dst The destination pixels, as 0x00RRGGBB.
+ * \param dst_width The destination width.
+ * \param dst_height The destination height.
+ * \param dst_stride The distance between destination rows, in pixels.
+ * \return 0 on success, or -1 if out of memory.
+ */
+int ScaleImageRGB(const unsigned char *src, int src_width, int src_height,
+                  uint32_t *dst, int dst_width, int dst_height,
+                  int dst_stride);
+
+#endif
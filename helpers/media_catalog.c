@@ -0,0 +1,746 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief Media catalog.
+ *
+ *Picks media files for the video savers to play, without scanning the whole
+ *media library every time a saver starts.
+ *
+ *The files in XSECURELOCK_VIDEOS_DIRS are indexed in a catalog file, which
+ *records each directory's modification time. On the next run, only
+ *directories whose modification time changed are read again; all others are
+ *just checked with a single stat call. An exclusive lock on the catalog makes
+ *concurrent savers (e.g. one per monitor) wait for a single update rather than
+ *each scanning on their own.
+ *
+ *If XSECURELOCK_LIST_VIDEOS_COMMAND is set, its output is used instead and
+ *nothing is cached.
+ *
+ *Usage:
+ *  media_catalog [-p] count
+ *
+ *Prints up to count files, chosen uniformly at random from all of them, one
+ *per line.
+ *
+ *With -p, still images are replaced by versions pre-scaled to the size of the
+ *XSCREENSAVER_WINDOW where available, as these decode a lot faster. Missing
+ *ones are then created in the background, for the next time, and the least
+ *recently used ones are removed once the cache exceeds
+ *XSECURELOCK_PRESCALE_CACHE_MB.
+ */
+
+#include <X11/X.h>      // for Window, None
+#include <X11/Xlib.h>   // for XOpenDisplay, XGetWindowAttributes
+#include <dirent.h>     // for closedir, opendir, readdir, DIR, dirent
+#include <errno.h>      // for errno, EEXIST, EINTR, ENOENT
+#include <fcntl.h>      // for fcntl, open, flock, F_SETLKW, F_WRLCK
+#include <stdio.h>      // for fprintf, fgets, fopen, popen, printf, rename
+#include <stdlib.h>     // for malloc, realloc, qsort, bsearch, random
+#include <string.h>     // for strcmp, strlen, strchr, strdup, strtok_r
+#include <strings.h>    // for strcasecmp
+#include <sys/stat.h>   // for stat, lstat, mkdir, S_ISDIR, S_ISREG
+#include <sys/time.h>   // for utimes
+#include <sys/wait.h>   // for waitpid
+#include <time.h>       // for time, time_t
+#include <unistd.h>     // for access, close, dup2, execl, fork, nice, rmdir
+
+#include "../env_settings.h"      // for GetStringSetting, GetIntSetting
+#include "../logging.h"           // for Log, LogErrno
+#include "../xscreensaver_api.h"  // for ReadWindowID
+
+//! Version line at the start of the catalog file.
+#define CATALOG_HEADER "xsecurelock-media-catalog 1\n"
+
+//! Maximum length of a line in the catalog, including the newline.
+#define MAX_LINE 8192
+
+//! Room for the longest file name to put in the cache directory.
+#define MAX_NAME 64
+
+struct Dir {
+  //! Absolute path of the directory.
+  char *path;
+  //! Modification time when it was read, or 0 if it has to be read again.
+  long long mtime;
+  //! Index of the directory's first entry in the entries array.
+  size_t first_entry;
+  //! Number of entries of the directory.
+  size_t num_entries;
+};
+
+struct Entry {
+  //! 'F' for a file, 'S' for a subdirectory.
+  char type;
+  //! Name of the entry inside its directory.
+  char *name;
+};
+
+struct Catalog {
+  struct Dir *dirs;
+  size_t num_dirs, max_dirs;
+  struct Entry *entries;
+  size_t num_entries, max_entries;
+};
+
+//! The time the catalog update started.
+static time_t now;
+
+static void *GrowArray(void *array, size_t *max, size_t size) {
+  *max = *max ? *max * 2 : 64;
+  void *new_array = realloc(array, *max * size);
+  if (new_array == NULL) {
+    Log("Out of memory");
+    exit(1);
+  }
+  return new_array;
+}
+
+static char *StrDupOrDie(const char *s) {
+  char *copy = strdup(s);
+  if (copy == NULL) {
+    Log("Out of memory");
+    exit(1);
+  }
+  return copy;
+}
+
+static void AddDir(struct Catalog *catalog, const char *path,
+                   long long mtime) {
+  if (catalog->num_dirs == catalog->max_dirs) {
+    catalog->dirs = GrowArray(catalog->dirs, &catalog->max_dirs,
+                              sizeof(*catalog->dirs));
+  }
+  struct Dir *dir = &catalog->dirs[catalog->num_dirs++];
+  dir->path = StrDupOrDie(path);
+  dir->mtime = mtime;
+  dir->first_entry = catalog->num_entries;
+  dir->num_entries = 0;
+}
+
+static void AddEntry(struct Catalog *catalog, char type, const char *name) {
+  if (catalog->num_entries == catalog->max_entries) {
+    catalog->entries = GrowArray(catalog->entries, &catalog->max_entries,
+                                 sizeof(*catalog->entries));
+  }
+  struct Entry *entry = &catalog->entries[catalog->num_entries++];
+  entry->type = type;
+  entry->name = StrDupOrDie(name);
+  ++catalog->dirs[catalog->num_dirs - 1].num_entries;
+}
+
+static int CompareDirs(const void *a, const void *b) {
+  return strcmp(((const struct Dir *)a)->path, ((const struct Dir *)b)->path);
+}
+
+/*! \brief Loads the catalog file.
+ *
+ * On any error, the catalog is left empty (or partially loaded, which is
+ * equally fine, as it only serves as a cache).
+ */
+static void LoadCatalog(struct Catalog *catalog, const char *filename) {
+  FILE *f = fopen(filename, "r");
+  if (f == NULL) {
+    if (errno != ENOENT) {
+      LogErrno("fopen %s", filename);
+    }
+    return;
+  }
+  char line[MAX_LINE];
+  if (fgets(line, sizeof(line), f) == NULL || strcmp(line, CATALOG_HEADER)) {
+    Log("Ignoring catalog %s with unknown format", filename);
+    fclose(f);
+    return;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    size_t len = strlen(line);
+    if (len < 3 || line[len - 1] != '\n' || line[1] != ' ') {
+      Log("Ignoring truncated catalog %s", filename);
+      break;
+    }
+    line[len - 1] = 0;
+    if (line[0] == 'D') {
+      char *path = strchr(line + 2, ' ');
+      if (path == NULL) {
+        break;
+      }
+      *path++ = 0;
+      AddDir(catalog, path, atoll(line + 2));
+    } else if ((line[0] == 'F' || line[0] == 'S') && catalog->num_dirs > 0) {
+      AddEntry(catalog, line[0], line + 2);
+    } else {
+      Log("Ignoring corrupt catalog %s", filename);
+      break;
+    }
+  }
+  fclose(f);
+  // Sort for lookup. The entry ranges move along with the directories.
+  qsort(catalog->dirs, catalog->num_dirs, sizeof(*catalog->dirs), CompareDirs);
+}
+
+static int SaveCatalog(const struct Catalog *catalog, const char *filename) {
+  char tmpname[MAX_LINE];
+  if (snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", filename) >=
+      (int)sizeof(tmpname)) {
+    Log("Catalog path %s too long", filename);
+    return -1;
+  }
+  int fd = mkstemp(tmpname);
+  if (fd == -1) {
+    LogErrno("mkstemp %s", tmpname);
+    return -1;
+  }
+  FILE *f = fdopen(fd, "w");
+  if (f == NULL) {
+    LogErrno("fdopen %s", tmpname);
+    close(fd);
+    unlink(tmpname);
+    return -1;
+  }
+  fputs(CATALOG_HEADER, f);
+  for (size_t i = 0; i < catalog->num_dirs; ++i) {
+    const struct Dir *dir = &catalog->dirs[i];
+    fprintf(f, "D %lld %s\n", dir->mtime, dir->path);
+    for (size_t j = 0; j < dir->num_entries; ++j) {
+      const struct Entry *entry = &catalog->entries[dir->first_entry + j];
+      fprintf(f, "%c %s\n", entry->type, entry->name);
+    }
+  }
+  if (fclose(f) != 0) {
+    LogErrno("write %s", tmpname);
+    unlink(tmpname);
+    return -1;
+  }
+  // Replace atomically, so concurrent readers never see a partial catalog.
+  if (rename(tmpname, filename) != 0) {
+    LogErrno("rename %s", tmpname);
+    unlink(tmpname);
+    return -1;
+  }
+  return 0;
+}
+
+/*! \brief Adds a directory and everything below it to the catalog.
+ *
+ * Directories unchanged since they were recorded in old are taken from there.
+ *
+ * \param is_root Whether path was configured by the user; only then symlinks
+ *   are followed.
+ */
+static void ScanDir(struct Catalog *catalog, const struct Catalog *old,
+                    const char *path, int is_root) {
+  struct stat st;
+  if ((is_root ? stat(path, &st) : lstat(path, &st)) != 0 ||
+      !S_ISDIR(st.st_mode)) {
+    return;
+  }
+  // Changes made in the same second as the scan might not change the
+  // modification time once more, so don't trust it for the next run.
+  long long mtime = (long long)st.st_mtime;
+  AddDir(catalog, path, mtime >= (long long)now - 1 ? 0 : mtime);
+  size_t this_dir = catalog->num_dirs - 1;
+
+  struct Dir key;
+  key.path = (char *)path;
+  const struct Dir *old_dir =
+      old->num_dirs == 0 ? NULL : bsearch(&key, old->dirs, old->num_dirs,
+                                          sizeof(*old->dirs), CompareDirs);
+  char child[MAX_LINE];
+  if (old_dir != NULL && old_dir->mtime != 0 && old_dir->mtime == mtime) {
+    for (size_t i = 0; i < old_dir->num_entries; ++i) {
+      const struct Entry *entry = &old->entries[old_dir->first_entry + i];
+      AddEntry(catalog, entry->type, entry->name);
+    }
+  } else {
+    DIR *d = opendir(path);
+    if (d == NULL) {
+      LogErrno("opendir %s", path);
+      return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+      if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..") ||
+          strchr(de->d_name, '\n') != NULL) {
+        continue;
+      }
+      if (snprintf(child, sizeof(child), "%s/%s", path, de->d_name) >=
+          (int)sizeof(child)) {
+        continue;
+      }
+      // Like find -type f, this does not follow symlinks.
+      if (lstat(child, &st) != 0) {
+        continue;
+      }
+      if (S_ISREG(st.st_mode)) {
+        AddEntry(catalog, 'F', de->d_name);
+      } else if (S_ISDIR(st.st_mode)) {
+        AddEntry(catalog, 'S', de->d_name);
+      }
+    }
+    closedir(d);
+  }
+
+  // Recurse into the subdirectories. Note that this grows the arrays, so no
+  // pointers into them are kept across the recursive call.
+  size_t first_entry = catalog->dirs[this_dir].first_entry;
+  size_t num_entries = catalog->dirs[this_dir].num_entries;
+  for (size_t i = 0; i < num_entries; ++i) {
+    const struct Entry *entry = &catalog->entries[first_entry + i];
+    if (entry->type != 'S') {
+      continue;
+    }
+    if (snprintf(child, sizeof(child), "%s/%s", path, entry->name) >=
+        (int)sizeof(child)) {
+      continue;
+    }
+    ScanDir(catalog, old, child, 0);
+  }
+}
+
+/*! \brief Gets the xsecurelock cache directory, creating it if needed.
+ *
+ * \return 0 on success; buf then has room for at least MAX_NAME more bytes.
+ */
+static int GetCacheDir(char *buf, size_t bufsize) {
+  const char *cache_home = GetStringSetting("XDG_CACHE_HOME", "");
+  int len;
+  if (*cache_home) {
+    len = snprintf(buf, bufsize, "%s/xsecurelock", cache_home);
+  } else {
+    const char *home = GetStringSetting("HOME", "");
+    if (!*home) {
+      Log("Neither $XDG_CACHE_HOME nor $HOME is set");
+      return -1;
+    }
+    len = snprintf(buf, bufsize, "%s/.cache/xsecurelock", home);
+  }
+  if (len < 0 || (size_t)len + MAX_NAME >= bufsize) {
+    Log("Cache directory path too long");
+    return -1;
+  }
+  // Create the directory and its parent; any real error shows up later.
+  char *slash = strrchr(buf, '/');
+  *slash = 0;
+  mkdir(buf, 0700);
+  *slash = '/';
+  if (mkdir(buf, 0700) != 0 && errno != EEXIST) {
+    LogErrno("mkdir %s", buf);
+    return -1;
+  }
+  return 0;
+}
+
+/*! \brief Brings the catalog file up to date and loads it.
+ */
+static void UpdateCatalog(struct Catalog *catalog) {
+  char filename[MAX_LINE];
+  if (GetCacheDir(filename, sizeof(filename))) {
+    return;
+  }
+  strcat(filename, "/media_catalog");
+  char lockname[MAX_LINE + sizeof(".lock")];
+  snprintf(lockname, sizeof(lockname), "%s.lock", filename);
+  int lock_fd = open(lockname, O_WRONLY | O_CREAT, 0600);
+  if (lock_fd == -1) {
+    LogErrno("open %s", lockname);
+  } else {
+    struct flock lock = {0};
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    while (fcntl(lock_fd, F_SETLKW, &lock) == -1 && errno == EINTR) {
+    }
+  }
+
+  struct Catalog old = {0};
+  LoadCatalog(&old, filename);
+
+  // If another saver updated the catalog while we waited for the lock, just
+  // use its result.
+  struct stat st;
+  if (lock_fd != -1 && stat(filename, &st) == 0 && st.st_mtime >= now) {
+    *catalog = old;
+    close(lock_fd);
+    return;
+  }
+
+  const char *home = GetStringSetting("HOME", "");
+  char *dirs =
+      StrDupOrDie(GetStringSetting("XSECURELOCK_VIDEOS_DIRS", "~/Videos"));
+  char *saveptr = NULL;
+  for (char *dir = strtok_r(dirs, ":", &saveptr); dir != NULL;
+       dir = strtok_r(NULL, ":", &saveptr)) {
+    char path[MAX_LINE];
+    if (dir[0] == '~' && (dir[1] == '/' || dir[1] == 0)) {
+      snprintf(path, sizeof(path), "%s%s", home, dir + 1);
+    } else {
+      snprintf(path, sizeof(path), "%s", dir);
+    }
+    ScanDir(catalog, &old, path, 1);
+  }
+  free(dirs);
+
+  SaveCatalog(catalog, filename);
+  if (lock_fd != -1) {
+    close(lock_fd);
+  }
+}
+
+/*! \brief Reads the list of files from XSECURELOCK_LIST_VIDEOS_COMMAND.
+ *
+ * The files are stored as entries of a single directory with an empty name.
+ */
+static void RunListCommand(struct Catalog *catalog, const char *command) {
+  AddDir(catalog, "", 0);
+  FILE *f = popen(command, "r");
+  if (f == NULL) {
+    LogErrno("popen %s", command);
+    return;
+  }
+  char line[MAX_LINE];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    size_t len = strlen(line);
+    if (len < 2 || line[len - 1] != '\n') {
+      continue;
+    }
+    line[len - 1] = 0;
+    AddEntry(catalog, 'F', line);
+  }
+  pclose(f);
+}
+
+//! File name extensions of still images worth pre-scaling.
+static const char *const image_extensions[] = {
+    ".bmp", ".jpeg", ".jpg", ".png", ".tif", ".tiff", ".webp", NULL,
+};
+
+static int IsImage(const char *path) {
+  const char *ext = strrchr(path, '.');
+  if (ext == NULL || strchr(ext, '/') != NULL) {
+    return 0;
+  }
+  for (const char *const *e = image_extensions; *e != NULL; ++e) {
+    if (!strcasecmp(ext, *e)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//! Pre-scaled images that still need to be created.
+struct Prescale {
+  //! Directory receiving the images for the current window size.
+  char dir[MAX_LINE];
+  int width, height;
+  size_t num_missing;
+  char **missing_src;
+  char **missing_dst;
+};
+
+/*! \brief Sets up pre-scaling for the size of the saver window.
+ *
+ * \return 0 if pre-scaled images shall be used.
+ */
+static int InitPrescale(struct Prescale *prescale, size_t max_missing) {
+  if (!GetIntSetting("XSECURELOCK_PRESCALE_IMAGES", 1)) {
+    return -1;
+  }
+  Window w = ReadWindowID();
+  if (w == None) {
+    return -1;
+  }
+  Display *display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    Log("Could not connect to $DISPLAY");
+    return -1;
+  }
+  XWindowAttributes xwa;
+  int ok = XGetWindowAttributes(display, w, &xwa);
+  XCloseDisplay(display);
+  if (!ok || xwa.width <= 0 || xwa.height <= 0) {
+    return -1;
+  }
+  prescale->width = xwa.width;
+  prescale->height = xwa.height;
+  if (GetCacheDir(prescale->dir, sizeof(prescale->dir))) {
+    return -1;
+  }
+  strcat(prescale->dir, "/scaled");
+  if (mkdir(prescale->dir, 0700) != 0 && errno != EEXIST) {
+    LogErrno("mkdir %s", prescale->dir);
+    return -1;
+  }
+  size_t len = strlen(prescale->dir);
+  snprintf(prescale->dir + len, sizeof(prescale->dir) - len, "/%dx%d",
+           prescale->width, prescale->height);
+  if (mkdir(prescale->dir, 0700) != 0 && errno != EEXIST) {
+    LogErrno("mkdir %s", prescale->dir);
+    return -1;
+  }
+  prescale->num_missing = 0;
+  prescale->missing_src = malloc(max_missing * sizeof(char *));
+  prescale->missing_dst = malloc(max_missing * sizeof(char *));
+  if (prescale->missing_src == NULL || prescale->missing_dst == NULL) {
+    Log("Out of memory");
+    exit(1);
+  }
+  return 0;
+}
+
+/*! \brief Returns the pre-scaled version of an image, if available.
+ *
+ * Images are keyed by path and modification time; the window size is part of
+ * the directory name. If no pre-scaled version exists yet, the image is
+ * queued for pre-scaling and the original path is returned.
+ */
+static const char *GetPrescaled(struct Prescale *prescale, const char *path,
+                                char *buf, size_t bufsize) {
+  struct stat st;
+  if (!IsImage(path) || stat(path, &st) != 0) {
+    return path;
+  }
+  // FNV-1a.
+  unsigned long long hash = 14695981039346656037ULL;
+  for (const char *p = path; *p; ++p) {
+    hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+  }
+  unsigned long long mtime = (unsigned long long)st.st_mtime;
+  for (int i = 0; i < 64; i += 8) {
+    hash = (hash ^ ((mtime >> i) & 0xFF)) * 1099511628211ULL;
+  }
+  snprintf(buf, bufsize, "%s/%016llx.jpg", prescale->dir, hash);
+  if (access(buf, R_OK) == 0) {
+    // Mark it as recently used, so PrunePrescaled keeps it.
+    utimes(buf, NULL);
+    return buf;
+  }
+  prescale->missing_src[prescale->num_missing] = StrDupOrDie(path);
+  prescale->missing_dst[prescale->num_missing] = StrDupOrDie(buf);
+  ++prescale->num_missing;
+  return path;
+}
+
+//! A file in the pre-scaled image cache.
+struct CachedFile {
+  char *path;
+  long long mtime;
+  long long size;
+};
+
+static int CompareCachedFiles(const void *a, const void *b) {
+  long long ma = ((const struct CachedFile *)a)->mtime;
+  long long mb = ((const struct CachedFile *)b)->mtime;
+  return (ma > mb) - (ma < mb);
+}
+
+/*! \brief Removes the least recently used pre-scaled images.
+ *
+ * Keeps the cache, for all window sizes together, below
+ * XSECURELOCK_PRESCALE_CACHE_MB. As GetPrescaled updates the modification time
+ * of every image it hands out, that is the time of last use. Size directories
+ * that end up empty (e.g. of monitors no longer in use) are removed too.
+ */
+static void PrunePrescaled(const struct Prescale *prescale) {
+  long long max_bytes =
+      GetIntSetting("XSECURELOCK_PRESCALE_CACHE_MB", 256) * 1048576LL;
+  if (max_bytes <= 0) {
+    return;
+  }
+  char root[MAX_LINE];
+  snprintf(root, sizeof(root), "%s", prescale->dir);
+  *strrchr(root, '/') = 0;
+  DIR *sizes = opendir(root);
+  if (sizes == NULL) {
+    LogErrno("opendir %s", root);
+    return;
+  }
+  struct CachedFile *files = NULL;
+  size_t num_files = 0, max_files = 0;
+  long long total_bytes = 0;
+  struct dirent *size_entry;
+  while ((size_entry = readdir(sizes)) != NULL) {
+    if (size_entry->d_name[0] == '.') {
+      continue;
+    }
+    char size_dir[MAX_LINE];
+    snprintf(size_dir, sizeof(size_dir), "%s/%s", root, size_entry->d_name);
+    DIR *d = opendir(size_dir);
+    if (d == NULL) {
+      continue;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+      char path[MAX_LINE];
+      struct stat st;
+      // Skips prescale_image's temporary directories too.
+      if (snprintf(path, sizeof(path), "%s/%s", size_dir, entry->d_name) >=
+              (int)sizeof(path) ||
+          lstat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        continue;
+      }
+      if (num_files == max_files) {
+        files = GrowArray(files, &max_files, sizeof(*files));
+      }
+      files[num_files].path = StrDupOrDie(path);
+      files[num_files].mtime = (long long)st.st_mtime;
+      files[num_files].size = (long long)st.st_size;
+      total_bytes += files[num_files].size;
+      ++num_files;
+    }
+    closedir(d);
+  }
+  if (total_bytes > max_bytes) {
+    qsort(files, num_files, sizeof(*files), CompareCachedFiles);
+    for (size_t i = 0; i < num_files && total_bytes > max_bytes; ++i) {
+      if (unlink(files[i].path) == 0 || errno == ENOENT) {
+        total_bytes -= files[i].size;
+      }
+      // Fails unless this was the last one of its size.
+      *strrchr(files[i].path, '/') = 0;
+      rmdir(files[i].path);
+    }
+  }
+  closedir(sizes);
+}
+
+/*! \brief Creates the missing pre-scaled images in the background.
+ *
+ * This runs at the lowest priority in a child process, which stays in the
+ * saver's process group, so it ends along with the saver. Afterwards, the
+ * cache gets pruned to its size limit.
+ */
+static void FillPrescaled(struct Prescale *prescale) {
+  // prescale_image is only installed along with mpv.
+  if (prescale->num_missing == 0 || access("./prescale_image", X_OK) != 0) {
+    return;
+  }
+  pid_t pid = fork();
+  if (pid == -1) {
+    LogErrno("fork");
+    return;
+  }
+  if (pid != 0) {
+    return;
+  }
+  // The saver reads its playlist until EOF, so let go of stdout.
+  int devnull = open("/dev/null", O_WRONLY);
+  if (devnull != -1) {
+    dup2(devnull, 1);
+    close(devnull);
+  }
+  errno = 0;
+  if (nice(19) == -1 && errno != 0) {
+    LogErrno("nice");
+  }
+  char width[16], height[16];
+  snprintf(width, sizeof(width), "%d", prescale->width);
+  snprintf(height, sizeof(height), "%d", prescale->height);
+  for (size_t i = 0; i < prescale->num_missing; ++i) {
+    // Another saver of the same size may have done it meanwhile.
+    if (access(prescale->missing_dst[i], R_OK) == 0) {
+      continue;
+    }
+    pid_t child = fork();
+    if (child == -1) {
+      LogErrno("fork");
+      break;
+    }
+    if (child == 0) {
+      execl("./prescale_image", "./prescale_image", prescale->missing_src[i],
+            prescale->missing_dst[i], width, height, (char *)NULL);
+      LogErrno("execl prescale_image");
+      _exit(1);
+    }
+    int status;
+    while (waitpid(child, &status, 0) == -1 && errno == EINTR) {
+    }
+  }
+  PrunePrescaled(prescale);
+  _exit(0);
+}
+
+int main(int argc, char **argv) {
+  int use_prescale = argc == 3 && !strcmp(argv[1], "-p");
+  if (argc != 2 && !use_prescale) {
+    Log("Usage: %s [-p] count", argv[0]);
+    return 1;
+  }
+  long count = atol(argv[argc - 1]);
+  now = time(NULL);
+  srandom((unsigned int)now ^ ((unsigned int)getpid() << 16));
+
+  struct Catalog catalog = {0};
+  const char *command = GetStringSetting("XSECURELOCK_LIST_VIDEOS_COMMAND", "");
+  if (*command) {
+    RunListCommand(&catalog, command);
+  } else {
+    UpdateCatalog(&catalog);
+  }
+
+  // Collect the files of all directories.
+  size_t num_files = 0;
+  size_t *files = malloc((catalog.num_entries + 1) * sizeof(*files));
+  size_t *file_dirs = malloc((catalog.num_entries + 1) * sizeof(*file_dirs));
+  if (files == NULL || file_dirs == NULL) {
+    Log("Out of memory");
+    return 1;
+  }
+  for (size_t i = 0; i < catalog.num_dirs; ++i) {
+    const struct Dir *dir = &catalog.dirs[i];
+    for (size_t j = 0; j < dir->num_entries; ++j) {
+      if (catalog.entries[dir->first_entry + j].type == 'F') {
+        file_dirs[num_files] = i;
+        files[num_files++] = dir->first_entry + j;
+      }
+    }
+  }
+
+  struct Prescale prescale;
+  if (use_prescale) {
+    size_t max_missing = count < 0 ? 0 : (size_t)count;
+    use_prescale = InitPrescale(&prescale, max_missing + 1) == 0;
+  }
+
+  // Partial Fisher-Yates shuffle: each printed file is chosen uniformly from
+  // the ones not printed yet.
+  for (size_t i = 0; i < num_files && (long)i < count; ++i) {
+    size_t j = i + (size_t)random() % (num_files - i);
+    size_t tmp = files[i];
+    files[i] = files[j];
+    files[j] = tmp;
+    tmp = file_dirs[i];
+    file_dirs[i] = file_dirs[j];
+    file_dirs[j] = tmp;
+    const char *dir = catalog.dirs[file_dirs[i]].path;
+    const char *name = catalog.entries[files[i]].name;
+    char path[MAX_LINE];
+    if (*dir) {
+      snprintf(path, sizeof(path), "%s/%s", dir, name);
+    } else {
+      snprintf(path, sizeof(path), "%s", name);
+    }
+    char prescaled[MAX_LINE];
+    printf("%s\n", use_prescale ? GetPrescaled(&prescale, path, prescaled,
+                                               sizeof(prescaled))
+                                : path);
+  }
+  fflush(stdout);
+
+  if (use_prescale) {
+    FillPrescaled(&prescale);
+  }
+
+  return 0;
+}
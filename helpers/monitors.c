@@ -16,9 +16,11 @@ limitations under the License.
 
 #include "monitors.h"
 
-#include <X11/Xlib.h>  // for XWindowAttributes, Display, XGetW...
-#include <stdlib.h>    // for qsort
+#include <X11/Xatom.h>  // for XA_CARDINAL
+#include <X11/Xlib.h>   // for XWindowAttributes, Display, XGetW...
+#include <stdlib.h>    // for qsort, free, calloc
 #include <string.h>    // for memcmp, memset
+#include <sys/time.h>  // for gettimeofday, timeval
 
 #ifdef HAVE_XRANDR_EXT
 #include <X11/extensions/Xrandr.h>  // for XRRMonitorInfo, XRRCrtcInfo, XRRO...
@@ -30,22 +32,80 @@ limitations under the License.
 
 #include "../env_settings.h"  // for GetIntSetting
 #include "../logging.h"       // for Log
+#include "../util.h"          // for MillisecondsSince
 
 #ifdef HAVE_XRANDR_EXT
 static Display* initialized_for = NULL;
 static int have_xrandr12_ext;
+static int have_xrandr13_ext;
 #ifdef HAVE_XRANDR15_EXT
 static int have_xrandr15_ext;
 #endif
 static int event_base;
 static int error_base;
 
+//! Cached state of an XRandR output.
+typedef struct {
+  RROutput id;
+  int connected;
+  //! The CRTC showing this output, or else its first possible CRTC.
+  RRCrtc crtc;
+  //! The first possible CRTC of this output.
+  RRCrtc first_crtc;
+  //! Whether this entry needs to be queried from the server.
+  int dirty;
+} CachedOutput;
+
+//! Cached state of an XRandR CRTC.
+typedef struct {
+  RRCrtc id;
+  int x, y, width, height;
+  //! Whether this entry needs to be queried from the server.
+  int dirty;
+} CachedCrtc;
+
+// The cache is only trusted while we receive change events to keep it
+// up to date, i.e. after SelectMonitorChangeEvents.
+static int cache_enabled;
+static XRRScreenResources* cached_screenres;
+static int resources_dirty = 1;
+static CachedOutput* cached_outputs;
+static CachedCrtc* cached_crtcs;
+#ifdef HAVE_XRANDR15_EXT
+static Monitor* cached_rrmonitors;
+static int num_cached_rrmonitors;
+static int rrmonitors_dirty = 1;
+#endif
+//! Number of XRandR requests done by the current GetMonitors call.
+static int num_requests;
+
+static void FreeMonitorCache(void) {
+  if (cached_screenres != NULL) {
+    XRRFreeScreenResources(cached_screenres);
+    cached_screenres = NULL;
+  }
+  free(cached_outputs);
+  cached_outputs = NULL;
+  free(cached_crtcs);
+  cached_crtcs = NULL;
+  resources_dirty = 1;
+#ifdef HAVE_XRANDR15_EXT
+  free(cached_rrmonitors);
+  cached_rrmonitors = NULL;
+  num_cached_rrmonitors = 0;
+  rrmonitors_dirty = 1;
+#endif
+}
+
 static int MaybeInitXRandR(Display* dpy) {
   if (dpy == initialized_for) {
     return have_xrandr12_ext;
   }
 
+  FreeMonitorCache();
+  cache_enabled = 0;
   have_xrandr12_ext = 0;
+  have_xrandr13_ext = 0;
 #ifdef HAVE_XRANDR15_EXT
   have_xrandr15_ext = 0;
 #endif
@@ -59,6 +119,10 @@ static int MaybeInitXRandR(Display* dpy) {
           have_xrandr12_ext = 1;
         }
       }
+      // XRandR 1.3 can query the current configuration without reprobing.
+      if (major > 1 || (major == 1 && minor >= 3)) {
+        have_xrandr13_ext = 1;
+      }
 #ifdef HAVE_XRANDR15_EXT
       if (major > 1 || (major == 1 && minor >= 5)) {
         if (!GetIntSetting("XSECURELOCK_NO_XRANDR15", 0)) {
@@ -75,6 +139,29 @@ static int MaybeInitXRandR(Display* dpy) {
 
 #define CLAMP(x, mi, ma) ((x) < (mi) ? (mi) : (x) > (ma) ? (ma) : (x))
 
+//! The name of the property holding the published monitor configuration.
+#define PUBLISHED_MONITORS_PROPERTY "_XSECURELOCK_MONITORS"
+
+//! The format version of the published monitor configuration.
+#define PUBLISHED_MONITORS_VERSION 1
+
+//! The maximum number of monitors to publish.
+#define MAX_PUBLISHED_MONITORS 64
+
+static Display* published_atom_for = NULL;
+static Atom published_atom;
+// Whether to read the published configuration instead of querying XRandR.
+static int use_published;
+
+static Atom GetPublishedMonitorsAtom(Display* dpy) {
+  if (dpy != published_atom_for) {
+    published_atom = XInternAtom(dpy, PUBLISHED_MONITORS_PROPERTY, False);
+    published_atom_for = dpy;
+    use_published = 0;
+  }
+  return published_atom;
+}
+
 static int CompareMonitors(const void* a, const void* b) {
   return memcmp(a, b, sizeof(Monitor));
 }
@@ -131,40 +218,141 @@ static void AddMonitor(Monitor* out_monitors, size_t* num_monitors,
 }
 
 #ifdef HAVE_XRANDR_EXT
-static int GetMonitorsXRandR12(Display* dpy, Window window, int wx, int wy,
-                               int ww, int wh, Monitor* out_monitors,
-                               size_t* out_num_monitors, size_t max_monitors) {
-  XRRScreenResources* screenres = XRRGetScreenResources(dpy, window);
+static CachedOutput* FindCachedOutput(RROutput id) {
+  if (cached_screenres == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < cached_screenres->noutput; ++i) {
+    if (cached_outputs[i].id == id) {
+      return &cached_outputs[i];
+    }
+  }
+  return NULL;
+}
+
+static CachedCrtc* FindCachedCrtc(RRCrtc id) {
+  if (cached_screenres == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < cached_screenres->ncrtc; ++i) {
+    if (cached_crtcs[i].id == id) {
+      return &cached_crtcs[i];
+    }
+  }
+  return NULL;
+}
+
+/*! \brief Refreshes the list of outputs and CRTCs.
+ *
+ * Cached output and CRTC info is kept if the lists did not change.
+ */
+static int RefreshScreenResources(Display* dpy) {
+  // Avoid XRRGetScreenResources where possible, as it may reprobe outputs,
+  // which can take hundreds of milliseconds on some drivers.
+  Window root = DefaultRootWindow(dpy);
+  XRRScreenResources* screenres = have_xrandr13_ext
+                                      ? XRRGetScreenResourcesCurrent(dpy, root)
+                                      : XRRGetScreenResources(dpy, root);
+  ++num_requests;
   if (screenres == NULL) {
     return 0;
   }
+  if (cached_screenres != NULL &&
+      screenres->noutput == cached_screenres->noutput &&
+      screenres->ncrtc == cached_screenres->ncrtc &&
+      !memcmp(screenres->outputs, cached_screenres->outputs,
+              screenres->noutput * sizeof(*screenres->outputs)) &&
+      !memcmp(screenres->crtcs, cached_screenres->crtcs,
+              screenres->ncrtc * sizeof(*screenres->crtcs))) {
+    // Same outputs and CRTCs as before; the events kept their info current.
+    XRRFreeScreenResources(cached_screenres);
+    cached_screenres = screenres;
+    resources_dirty = 0;
+    return 1;
+  }
+  FreeMonitorCache();
+  cached_screenres = screenres;
+  cached_outputs = calloc(screenres->noutput + 1, sizeof(*cached_outputs));
+  cached_crtcs = calloc(screenres->ncrtc + 1, sizeof(*cached_crtcs));
+  if (cached_outputs == NULL || cached_crtcs == NULL) {
+    Log("Out of memory");
+    FreeMonitorCache();
+    return 0;
+  }
   for (int i = 0; i < screenres->noutput; ++i) {
-    XRROutputInfo* output =
-        XRRGetOutputInfo(dpy, screenres, screenres->outputs[i]);
-    if (output == NULL) {
+    cached_outputs[i].id = screenres->outputs[i];
+    cached_outputs[i].dirty = 1;
+  }
+  for (int i = 0; i < screenres->ncrtc; ++i) {
+    cached_crtcs[i].id = screenres->crtcs[i];
+    cached_crtcs[i].dirty = 1;
+  }
+  resources_dirty = 0;
+  return 1;
+}
+
+static void RefreshOutput(Display* dpy, CachedOutput* cached) {
+  XRROutputInfo* output = XRRGetOutputInfo(dpy, cached_screenres, cached->id);
+  ++num_requests;
+  if (output == NULL) {
+    cached->connected = 0;
+    return;
+  }
+  cached->connected = output->connection == RR_Connected;
+  cached->first_crtc = output->ncrtc ? output->crtcs[0] : 0;
+  // NOTE: If an output has multiple Crtcs (i.e. if the screen is cloned), we
+  // only look at the first. Let's assume that the center of that one should
+  // always be onscreen anyway (even though they may not be, as cloned
+  // displays can have different panning settings).
+  cached->crtc = output->crtc ? output->crtc : cached->first_crtc;
+  cached->dirty = 0;
+  XRRFreeOutputInfo(output);
+}
+
+static void RefreshCrtc(Display* dpy, CachedCrtc* cached) {
+  XRRCrtcInfo* info = XRRGetCrtcInfo(dpy, cached_screenres, cached->id);
+  ++num_requests;
+  if (info == NULL) {
+    cached->width = 0;
+    cached->height = 0;
+    return;
+  }
+  cached->x = info->x;
+  cached->y = info->y;
+  cached->width = info->width;
+  cached->height = info->height;
+  cached->dirty = 0;
+  XRRFreeCrtcInfo(info);
+}
+
+static int GetMonitorsXRandR12(Display* dpy, int wx, int wy, int ww, int wh,
+                               Monitor* out_monitors, size_t* out_num_monitors,
+                               size_t max_monitors) {
+  if (resources_dirty && !RefreshScreenResources(dpy)) {
+    return 0;
+  }
+  // Only query what changed since the last call.
+  for (int i = 0; i < cached_screenres->noutput; ++i) {
+    CachedOutput* output = &cached_outputs[i];
+    if (output->dirty) {
+      RefreshOutput(dpy, output);
+    }
+    if (!output->connected || output->crtc == 0) {
       continue;
     }
-    if (output->connection == RR_Connected) {
-      // NOTE: If an output has multiple Crtcs (i.e. if the screen is
-      // cloned), we only look at the first. Let's assume that the center
-      // of that one should always be onscreen anyway (even though they
-      // may not be, as cloned displays can have different panning
-      // settings).
-      RRCrtc crtc =
-          (output->crtc ? output->crtc : output->ncrtc ? output->crtcs[0] : 0);
-      XRRCrtcInfo* info = (crtc ? XRRGetCrtcInfo(dpy, screenres, crtc) : 0);
-      if (info != NULL) {
-        int x = CLAMP(info->x, wx, wx + ww) - wx;
-        int y = CLAMP(info->y, wy, wy + wh) - wy;
-        int w = CLAMP(info->x + (int)info->width, wx + x, wx + ww) - (wx + x);
-        int h = CLAMP(info->y + (int)info->height, wy + y, wy + wh) - (wy + y);
-        AddMonitor(out_monitors, out_num_monitors, max_monitors, x, y, w, h);
-        XRRFreeCrtcInfo(info);
-      }
+    CachedCrtc* info = FindCachedCrtc(output->crtc);
+    if (info == NULL) {
+      continue;
     }
-    XRRFreeOutputInfo(output);
+    if (info->dirty) {
+      RefreshCrtc(dpy, info);
+    }
+    int x = CLAMP(info->x, wx, wx + ww) - wx;
+    int y = CLAMP(info->y, wy, wy + wh) - wy;
+    int w = CLAMP(info->x + info->width, wx + x, wx + ww) - (wx + x);
+    int h = CLAMP(info->y + info->height, wy + y, wy + wh) - (wy + y);
+    AddMonitor(out_monitors, out_num_monitors, max_monitors, x, y, w, h);
   }
-  XRRFreeScreenResources(screenres);
   return *out_num_monitors != 0;
 }
 
@@ -175,20 +363,41 @@ static int GetMonitorsXRandR15(Display* dpy, Window window, int wx, int wy,
   if (!have_xrandr15_ext) {
     return 0;
   }
-  int num_rrmonitors;
-  XRRMonitorInfo* rrmonitors = XRRGetMonitors(dpy, window, 1, &num_rrmonitors);
-  if (rrmonitors == NULL) {
-    return 0;
+  if (rrmonitors_dirty) {
+    // There are no incremental events for monitors, so refetch the list.
+    int num_rrmonitors;
+    XRRMonitorInfo* rrmonitors =
+        XRRGetMonitors(dpy, window, 1, &num_rrmonitors);
+    ++num_requests;
+    if (rrmonitors == NULL) {
+      return 0;
+    }
+    free(cached_rrmonitors);
+    cached_rrmonitors = calloc(num_rrmonitors + 1, sizeof(*cached_rrmonitors));
+    if (cached_rrmonitors == NULL) {
+      Log("Out of memory");
+      num_cached_rrmonitors = 0;
+      XRRFreeMonitors(rrmonitors);
+      return 0;
+    }
+    for (int i = 0; i < num_rrmonitors; ++i) {
+      cached_rrmonitors[i].x = rrmonitors[i].x;
+      cached_rrmonitors[i].y = rrmonitors[i].y;
+      cached_rrmonitors[i].width = rrmonitors[i].width;
+      cached_rrmonitors[i].height = rrmonitors[i].height;
+    }
+    num_cached_rrmonitors = num_rrmonitors;
+    rrmonitors_dirty = 0;
+    XRRFreeMonitors(rrmonitors);
   }
-  for (int i = 0; i < num_rrmonitors; ++i) {
-    XRRMonitorInfo* info = &rrmonitors[i];
+  for (int i = 0; i < num_cached_rrmonitors; ++i) {
+    Monitor* info = &cached_rrmonitors[i];
     int x = CLAMP(info->x, wx, wx + ww) - wx;
     int y = CLAMP(info->y, wy, wy + wh) - wy;
     int w = CLAMP(info->x + info->width, wx + x, wx + ww) - (wx + x);
     int h = CLAMP(info->y + info->height, wy + y, wy + wh) - (wy + y);
     AddMonitor(out_monitors, out_num_monitors, max_monitors, x, y, w, h);
   }
-  XRRFreeMonitors(rrmonitors);
   return *out_num_monitors != 0;
 }
 #endif
@@ -201,6 +410,22 @@ static int GetMonitorsXRandR(Display* dpy, Window window,
     return 0;
   }
 
+  if (!cache_enabled) {
+    // Without change events, we cannot know what changed.
+    resources_dirty = 1;
+    for (int i = 0; cached_screenres != NULL && i < cached_screenres->noutput;
+         ++i) {
+      cached_outputs[i].dirty = 1;
+    }
+    for (int i = 0; cached_screenres != NULL && i < cached_screenres->ncrtc;
+         ++i) {
+      cached_crtcs[i].dirty = 1;
+    }
+#ifdef HAVE_XRANDR15_EXT
+    rrmonitors_dirty = 1;
+#endif
+  }
+
   // Translate to absolute coordinates so we can compare them to XRandR data.
   int wx, wy;
   Window child;
@@ -218,11 +443,49 @@ static int GetMonitorsXRandR(Display* dpy, Window window,
   }
 #endif
 
-  return GetMonitorsXRandR12(dpy, window, wx, wy, xwa->width, xwa->height,
+  return GetMonitorsXRandR12(dpy, wx, wy, xwa->width, xwa->height,
                              out_monitors, out_num_monitors, max_monitors);
 }
 #endif
 
+static int GetMonitorsPublished(Display* dpy, Window window,
+                                const XWindowAttributes* xwa,
+                                Monitor* out_monitors, size_t* out_num_monitors,
+                                size_t max_monitors) {
+  Atom type;
+  int format;
+  unsigned long nitems, bytes_after;
+  unsigned char* data = NULL;
+  if (XGetWindowProperty(dpy, window, GetPublishedMonitorsAtom(dpy), 0,
+                         2 + 4 * MAX_PUBLISHED_MONITORS, False, XA_CARDINAL,
+                         &type, &format, &nitems, &bytes_after,
+                         &data) != Success) {
+    return 0;
+  }
+  // Format 32 properties are returned as an array of long.
+  const long* values = (const long*)data;
+  int ok = data != NULL && type == XA_CARDINAL && format == 32 && nitems >= 2 &&
+           values[0] == PUBLISHED_MONITORS_VERSION && values[1] >= 0 &&
+           nitems >= 2 + 4 * (unsigned long)values[1];
+  if (ok) {
+    // The published configuration is in root window coordinates, which our
+    // windows share; just clip to the window.
+    for (long i = 0; i < values[1]; ++i) {
+      const long* rect = values + 2 + 4 * i;
+      int x = CLAMP(rect[0], 0, xwa->width);
+      int y = CLAMP(rect[1], 0, xwa->height);
+      int w = CLAMP(rect[0] + rect[2], x, xwa->width) - x;
+      int h = CLAMP(rect[1] + rect[3], y, xwa->height) - y;
+      AddMonitor(out_monitors, out_num_monitors, max_monitors, x, y, w, h);
+    }
+    ok = *out_num_monitors != 0;
+  }
+  if (data != NULL) {
+    XFree(data);
+  }
+  return ok;
+}
+
 static void GetMonitorsGuess(const XWindowAttributes* xwa,
                              Monitor* out_monitors, size_t* out_num_monitors,
                              size_t max_monitors) {
@@ -253,9 +516,22 @@ size_t GetMonitors(Display* dpy, Window window, Monitor* out_monitors,
   XGetWindowAttributes(dpy, window, &xwa);
 
   do {
+    if (use_published && GetMonitorsPublished(dpy, window, &xwa, out_monitors,
+                                              &num_monitors, max_monitors)) {
+      break;
+    }
 #ifdef HAVE_XRANDR_EXT
-    if (GetMonitorsXRandR(dpy, window, &xwa, out_monitors, &num_monitors,
-                          max_monitors)) {
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    num_requests = 0;
+    int ok = GetMonitorsXRandR(dpy, window, &xwa, out_monitors, &num_monitors,
+                               max_monitors);
+    // Refreshes come in storms when docking, so only log them on request.
+    if (num_requests != 0 && GetIntSetting("XSECURELOCK_DEBUG_TIMING", 0)) {
+      Log("Refreshed monitor topology with %d XRandR requests in %.3f ms",
+          num_requests, MillisecondsSince(&start));
+    }
+    if (ok) {
       break;
     }
 #endif
@@ -274,12 +550,56 @@ size_t GetMonitors(Display* dpy, Window window, Monitor* out_monitors,
   return num_monitors;
 }
 
+void PublishMonitors(Display* dpy, const Window* windows, size_t num_windows) {
+  Monitor monitors[MAX_PUBLISHED_MONITORS];
+  size_t num_monitors = GetMonitors(dpy, DefaultRootWindow(dpy), monitors,
+                                    MAX_PUBLISHED_MONITORS);
+  long values[2 + 4 * MAX_PUBLISHED_MONITORS];
+  values[0] = PUBLISHED_MONITORS_VERSION;
+  values[1] = num_monitors;
+  for (size_t i = 0; i < num_monitors; ++i) {
+    values[2 + 4 * i] = monitors[i].x;
+    values[3 + 4 * i] = monitors[i].y;
+    values[4 + 4 * i] = monitors[i].width;
+    values[5 + 4 * i] = monitors[i].height;
+  }
+  Atom atom = GetPublishedMonitorsAtom(dpy);
+  for (size_t i = 0; i < num_windows; ++i) {
+    XChangeProperty(dpy, windows[i], atom, XA_CARDINAL, 32, PropModeReplace,
+                    (const unsigned char*)values, 2 + 4 * num_monitors);
+  }
+}
+
 void SelectMonitorChangeEvents(Display* dpy, Window window) {
+  // If our configuration is published on the window, just watch that.
+  Atom type;
+  int format;
+  unsigned long nitems, bytes_after;
+  unsigned char* data = NULL;
+  if (XGetWindowProperty(dpy, window, GetPublishedMonitorsAtom(dpy), 0, 0,
+                         False, XA_CARDINAL, &type, &format, &nitems,
+                         &bytes_after, &data) == Success &&
+      type == XA_CARDINAL) {
+    XWindowAttributes xwa;
+    XGetWindowAttributes(dpy, window, &xwa);
+    XSelectInput(dpy, window, xwa.your_event_mask | PropertyChangeMask);
+    use_published = 1;
+  }
+  if (data != NULL) {
+    XFree(data);
+  }
+  if (use_published) {
+    return;
+  }
+
 #ifdef HAVE_XRANDR_EXT
   if (MaybeInitXRandR(dpy)) {
     XRRSelectInput(dpy, window,
                    RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask |
                        RROutputChangeNotifyMask);
+    // Anything cached so far may predate the events.
+    FreeMonitorCache();
+    cache_enabled = 1;
   }
 #else
   (void)dpy;
@@ -287,23 +607,100 @@ void SelectMonitorChangeEvents(Display* dpy, Window window) {
 #endif
 }
 
-int IsMonitorChangeEvent(Display* dpy, int type) {
+int IsMonitorChangeEvent(Display* dpy, XEvent* ev) {
+  if (use_published) {
+    return ev->type == PropertyNotify &&
+           ev->xproperty.atom == GetPublishedMonitorsAtom(dpy);
+  }
+
 #ifdef HAVE_XRANDR_EXT
   if (MaybeInitXRandR(dpy)) {
-    switch (type - event_base) {
+    switch (ev->type - event_base) {
       case RRScreenChangeNotify:
-      case RRNotify + RRNotify_CrtcChange:
-      case RRNotify + RRNotify_OutputChange:
+        XRRUpdateConfiguration(ev);
+        // Outputs or CRTCs may have been added or removed.
+        resources_dirty = 1;
+#ifdef HAVE_XRANDR15_EXT
+        rrmonitors_dirty = 1;
+#endif
         return 1;
+      case RRNotify: {
+        XRRNotifyEvent* notify = (XRRNotifyEvent*)ev;
+#ifdef HAVE_XRANDR15_EXT
+        rrmonitors_dirty = 1;
+#endif
+        if (notify->subtype == RRNotify_CrtcChange) {
+          XRRCrtcChangeNotifyEvent* change = (XRRCrtcChangeNotifyEvent*)ev;
+          CachedCrtc* crtc = FindCachedCrtc(change->crtc);
+          if (crtc == NULL) {
+            resources_dirty = 1;
+          } else {
+            // The event has the size of the mode, not of the scanout area,
+            // which differs for rotated or transformed CRTCs. So refetch.
+            crtc->dirty = 1;
+          }
+          return 1;
+        }
+        if (notify->subtype == RRNotify_OutputChange) {
+          XRROutputChangeNotifyEvent* change = (XRROutputChangeNotifyEvent*)ev;
+          CachedOutput* output = FindCachedOutput(change->output);
+          if (output == NULL) {
+            resources_dirty = 1;
+          } else if (!output->dirty) {
+            output->connected = change->connection == RR_Connected;
+            output->crtc = change->crtc ? change->crtc : output->first_crtc;
+          }
+          if (change->crtc && FindCachedCrtc(change->crtc) == NULL) {
+            resources_dirty = 1;
+          }
+          return 1;
+        }
+        return 0;
+      }
       default:
         return 0;
     }
   }
 #else
   (void)dpy;
-  (void)type;
+  (void)ev;
 #endif
 
   // XRandR-less dummy fallback.
   return 0;
 }
+
+void NoteMonitorChange(MonitorChangeSettle* settle) {
+  gettimeofday(&settle->last, NULL);
+  if (settle->num_events++ == 0) {
+    settle->first = settle->last;
+  }
+}
+
+int MonitorChangeSettleTimeoutMs(const MonitorChangeSettle* settle) {
+  if (settle->num_events == 0) {
+    return -1;
+  }
+  // A published configuration has already been settled by the publisher.
+  int settle_ms =
+      use_published ? 0 : GetIntSetting("XSECURELOCK_MONITOR_SETTLE_MS", 250);
+  int max_ms = GetIntSetting("XSECURELOCK_MONITOR_SETTLE_MAX_MS", 2000);
+  int timeout_ms = settle_ms - (int)MillisecondsSince(&settle->last);
+  int max_timeout_ms = max_ms - (int)MillisecondsSince(&settle->first);
+  if (max_timeout_ms < timeout_ms) {
+    timeout_ms = max_timeout_ms;
+  }
+  return timeout_ms < 0 ? 0 : timeout_ms;
+}
+
+int MonitorChangeSettled(MonitorChangeSettle* settle) {
+  if (MonitorChangeSettleTimeoutMs(settle) != 0) {
+    return 0;
+  }
+  if (settle->num_events > 1) {
+    Log("Coalesced %d monitor change events over %.0f ms", settle->num_events,
+        MillisecondsSince(&settle->first));
+  }
+  settle->num_events = 0;
+  return 1;
+}
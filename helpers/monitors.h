@@ -20,11 +20,20 @@ limitations under the License.
 #include <X11/X.h>     // for Window
 #include <X11/Xlib.h>  // for Display
 #include <stddef.h>    // for size_t
+#include <sys/time.h>  // for timeval
 
 typedef struct {
   int x, y, width, height;
 } Monitor;
 
+//! Coalesces bursts of monitor change events, e.g. when docking.
+typedef struct {
+  //! Number of change events since the last applied update.
+  int num_events;
+  //! Time of the first and last change event since the last applied update.
+  struct timeval first, last;
+} MonitorChangeSettle;
+
 /*! \brief Queries the current monitor configuration.
  *
  * Note: out_monitors will be zero padded and sorted in some deterministic order
@@ -41,19 +50,58 @@ typedef struct {
 size_t GetMonitors(Display* dpy, Window window, Monitor* out_monitors,
                    size_t max_monitors);
 
+/*! \brief Publishes the monitor configuration on the given windows.
+ *
+ * The configuration is stored in root window coordinates in a property, so
+ * helpers drawing on these windows can get it with a single request instead
+ * of querying XRandR themselves. Call again to update it.
+ */
+void PublishMonitors(Display* dpy, const Window* windows, size_t num_windows);
+
 /*! \brief Enable receiving monitor change events for the given display at w.
+ *
+ * If the monitor configuration has been published on w, this watches for
+ * updates of the published configuration instead; all subsequent GetMonitors
+ * calls then use that configuration.
  */
 void SelectMonitorChangeEvents(Display* dpy, Window window);
 
-/*! \brief Returns the event type that indicates a change to the monitor
+/*! \brief Checks whether an event indicates a change to the monitor
  *    configuration.
  *
+ * Also applies the event to the cached monitor configuration, so that
+ * GetMonitors only needs to query what changed. For this, all events received
+ * after SelectMonitorChangeEvents must be passed here.
+ *
  * \param dpy The current display.
- * \param type The received event type.
+ * \param ev The received event.
  *
  * \returns 1 if the received event is a monitor change event and GetMonitors
  *   should be called, or 0 otherwise.
  */
-int IsMonitorChangeEvent(Display* dpy, int type);
+int IsMonitorChangeEvent(Display* dpy, XEvent* ev);
+
+/*! \brief Records a monitor change event for later application.
+ *
+ * Call this instead of GetMonitors when IsMonitorChangeEvent returns 1, and
+ * apply the change once MonitorChangeSettled returns 1.
+ */
+void NoteMonitorChange(MonitorChangeSettle* settle);
+
+/*! \brief Returns how long to wait until MonitorChangeSettled should be called.
+ *
+ * \return The time in milliseconds, or -1 if no change is pending.
+ */
+int MonitorChangeSettleTimeoutMs(const MonitorChangeSettle* settle);
+
+/*! \brief Checks whether pending monitor changes should be applied now.
+ *
+ * This is the case when no change events arrived for
+ * XSECURELOCK_MONITOR_SETTLE_MS, or when the first one is older than
+ * XSECURELOCK_MONITOR_SETTLE_MAX_MS.
+ *
+ * \return 1 if GetMonitors should be called now, 0 otherwise.
+ */
+int MonitorChangeSettled(MonitorChangeSettle* settle);
 
 #endif
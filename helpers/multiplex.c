@@ -0,0 +1,186 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "multiplex.h"
+
+#include <X11/X.h>     // for Window, CopyFromParent, InputOutput
+#include <X11/Xlib.h>  // for XCreateWindow, XDestroyWindow, XFlush, XMapR...
+#include <stddef.h>    // for size_t, NULL
+#include <string.h>    // for memcmp, memcpy
+#include <sys/time.h>  // for gettimeofday, timeval
+
+#include "../env_settings.h"   // for GetIntSetting
+#include "../saver_child.h"    // for MAX_SAVERS, WatchSaverChild, SetSave...
+#include "../util.h"           // for MillisecondsSince
+#include "../wm_properties.h"  // for SetWMProperties
+#include "monitors.h"          // for GetMonitors, Monitor
+
+#define MAX_MONITORS MAX_SAVERS
+
+static Display* display;
+static Window parent;
+static const char* saver_executable;
+static int saver_argc;
+static char* const* saver_argv;
+
+static Monitor monitors[MAX_MONITORS];
+static size_t num_monitors;
+static Window windows[MAX_MONITORS];
+
+//! Delay between starting the savers of successive monitors.
+static int stagger_ms;
+//! How much to lower the priority of all but the first saver.
+static int secondary_nice;
+//! Whether the savers should be running.
+static int running;
+//! The monitor indexes in the order their savers get started.
+static size_t start_order[MAX_MONITORS];
+//! How many savers, in start_order, may be running by now.
+static size_t num_released;
+//! When the savers were last started.
+static struct timeval start_time;
+
+/*! \brief Finds the monitor the user is most likely looking at.
+ *
+ * \return The index of the monitor the pointer is on, or 0 if unknown.
+ */
+static size_t FindPointerMonitor(void) {
+  Window root, child;
+  int root_x, root_y, x, y;
+  unsigned int mask;
+  if (!XQueryPointer(display, parent, &root, &child, &root_x, &root_y, &x, &y,
+                     &mask)) {
+    return 0;
+  }
+  for (size_t i = 0; i < num_monitors; ++i) {
+    if (x >= monitors[i].x && x < monitors[i].x + monitors[i].width &&
+        y >= monitors[i].y && y < monitors[i].y + monitors[i].height) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+static void StartStagger(void) {
+  // The screen the user is looking at shall come up first; the others follow
+  // one by one, so they don't all compete for disk, decoder and GPU at once.
+  size_t first = FindPointerMonitor();
+  start_order[0] = first;
+  for (size_t i = 0, k = 1; i < num_monitors; ++i) {
+    if (i != first) {
+      start_order[k++] = i;
+    }
+  }
+  for (size_t k = 0; k < num_monitors; ++k) {
+    SetSaverChildNice(start_order[k], k == 0 ? 0 : secondary_nice);
+  }
+  gettimeofday(&start_time, NULL);
+  num_released = 0;
+}
+
+static void CreateWindows(void) {
+  for (size_t i = 0; i < num_monitors; ++i) {
+    windows[i] =
+        XCreateWindow(display, parent, monitors[i].x, monitors[i].y,
+                      monitors[i].width, monitors[i].height, 0, CopyFromParent,
+                      InputOutput, CopyFromParent, 0, NULL);
+    SetWMProperties(display, windows[i], "xsecurelock",
+                    "saver_multiplex_screen", saver_argc, saver_argv);
+    XMapRaised(display, windows[i]);
+  }
+  // Need to flush the display so savers sure can access the window.
+  XFlush(display);
+}
+
+static void DestroyWindows(void) {
+  for (size_t i = 0; i < num_monitors; ++i) {
+    // Savers that were not released yet are not running, so this is a no-op
+    // for them.
+    WatchSaverChild(display, windows[i], i, saver_executable, 0);
+    XDestroyWindow(display, windows[i]);
+  }
+}
+
+void InitMultiplex(Display* dpy, Window w, const char* executable, int argc,
+                   char* const* argv) {
+  display = dpy;
+  parent = w;
+  saver_executable = executable;
+  saver_argc = argc;
+  saver_argv = argv;
+  stagger_ms = GetIntSetting("XSECURELOCK_SAVER_STAGGER_MS", 250);
+  secondary_nice = GetIntSetting("XSECURELOCK_SAVER_SECONDARY_NICE", 5);
+  running = 0;
+  num_monitors = GetMonitors(display, parent, monitors, MAX_MONITORS);
+}
+
+void WatchMultiplexedSavers(int should_be_running) {
+  // Like saver_multiplex, only have the windows while the savers run.
+  if (should_be_running && !running) {
+    CreateWindows();
+    StartStagger();
+  } else if (!should_be_running && running) {
+    DestroyWindows();
+  }
+  running = should_be_running;
+  if (running) {
+    // Release the next savers once their turn has come.
+    while (num_released < num_monitors &&
+           MillisecondsSince(&start_time) >=
+               (double)num_released * stagger_ms) {
+      ++num_released;
+    }
+    for (size_t k = 0; k < num_released; ++k) {
+      size_t i = start_order[k];
+      WatchSaverChild(display, windows[i], i, saver_executable, 1);
+    }
+  }
+  WatchStoppingSaverChildren();
+}
+
+int MultiplexTimeoutMs(void) {
+  int timeout_ms = SaverChildrenTimeoutMs();
+  if (!running || num_released >= num_monitors) {
+    return timeout_ms;
+  }
+  double remaining_ms =
+      (double)num_released * stagger_ms - MillisecondsSince(&start_time);
+  int stagger_timeout_ms = remaining_ms > 0 ? (int)remaining_ms + 1 : 0;
+  if (timeout_ms < 0 || stagger_timeout_ms < timeout_ms) {
+    timeout_ms = stagger_timeout_ms;
+  }
+  return timeout_ms;
+}
+
+void UpdateMultiplexedMonitors(void) {
+  Monitor new_monitors[MAX_MONITORS];
+  size_t new_num_monitors =
+      GetMonitors(display, parent, new_monitors, MAX_MONITORS);
+  if (new_num_monitors == num_monitors &&
+      memcmp(new_monitors, monitors, sizeof(monitors)) == 0) {
+    return;
+  }
+  if (running) {
+    DestroyWindows();
+  }
+  num_monitors = new_num_monitors;
+  memcpy(monitors, new_monitors, sizeof(monitors));
+  if (running) {
+    CreateWindows();
+    StartStagger();
+    WatchMultiplexedSavers(1);
+  }
+}
@@ -0,0 +1,64 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef MULTIPLEX_H
+#define MULTIPLEX_H
+
+#include <X11/X.h>     // for Window
+#include <X11/Xlib.h>  // for Display
+
+/*! \brief Prepares running one saver child per monitor.
+ *
+ * Each saver child gets its own window, a child of parent, and uses the index
+ * of its monitor for WatchSaverChild. Reads
+ * XSECURELOCK_SAVER_STAGGER_MS and XSECURELOCK_SAVER_SECONDARY_NICE.
+ *
+ * The caller must have called SelectMonitorChangeEvents already, and must call
+ * UpdateMultiplexedMonitors once monitor changes have settled.
+ *
+ * \param dpy The X11 display.
+ * \param parent The window to cover with the per-monitor windows.
+ * \param executable The saver to run on each monitor.
+ * \param argc The argc to set on the per-monitor windows.
+ * \param argv The argv to set on the per-monitor windows.
+ */
+void InitMultiplex(Display* dpy, Window parent, const char* executable,
+                   int argc, char* const* argv);
+
+/*! \brief Starts or stops the per-monitor saver children.
+ *
+ * When starting, the windows get created, and the saver on the monitor with
+ * the pointer comes up first; the others follow one by one. When stopping, the
+ * windows get destroyed.
+ *
+ * Also makes progress on saver children that are terminating.
+ *
+ * \param should_be_running Whether the savers should be running.
+ */
+void WatchMultiplexedSavers(int should_be_running);
+
+/*! \brief Returns how soon WatchMultiplexedSavers should be called again.
+ *
+ * \return The time in milliseconds, or -1 if there is nothing to do.
+ */
+int MultiplexTimeoutMs(void);
+
+/*! \brief Checks the monitor configuration, and if it changed, recreates the
+ * per-monitor windows and restarts their savers if they are running.
+ */
+void UpdateMultiplexedMonitors(void);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief Pre-staged locker protocol.
+ *
+ *Lets xsecurelock prepare itself while the screen dims, so the lock can be
+ *committed instantly.
+ */
+
+#include "prestage.h"
+
+#include <errno.h>       // for EINTR, ECONNRESET, EPIPE, errno
+#include <fcntl.h>       // for fcntl, FD_CLOEXEC, F_GETFD, F_SETFD
+#include <poll.h>        // for poll, pollfd, POLLIN
+#include <stdio.h>       // for snprintf
+#include <stdlib.h>      // for EXIT_FAILURE, setenv
+#include <sys/socket.h>  // for send, socketpair, AF_UNIX, MSG_NOSIGNAL
+#include <sys/time.h>    // for gettimeofday, timeval
+#include <unistd.h>      // for _exit, close, execvp, read
+
+#include "../logging.h"    // for Log, LogErrno
+#include "../util.h"       // for MillisecondsSince
+#include "../wait_pgrp.h"  // for ForkWithoutSigHandlers, StartPgrp
+
+/*! \brief How long to wait for the locker to confirm the lock.
+ *
+ * This covers grabbing (which xsecurelock retries for about a second) and
+ * mapping its windows. Some compositors never report the lock window as
+ * unobscured, so the confirmation may never come.
+ */
+#define COMMIT_TIMEOUT_MS 5000
+
+int StartPrestagedLocker(char **locker_argv, pid_t *lockerpid) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    LogErrno("socketpair");
+    return -1;
+  }
+  // Neither the dimming tool nor the locker's children shall inherit these.
+  for (int i = 0; i < 2; ++i) {
+    int flags = fcntl(fds[i], F_GETFD);
+    if (flags == -1 || fcntl(fds[i], F_SETFD, flags | FD_CLOEXEC) == -1) {
+      LogErrno("fcntl(FD_CLOEXEC)");
+    }
+  }
+  *lockerpid = ForkWithoutSigHandlers();
+  if (*lockerpid == -1) {
+    LogErrno("fork");
+    *lockerpid = 0;
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  if (*lockerpid == 0) {
+    // Child process.
+    StartPgrp();
+    close(fds[0]);
+    int flags = fcntl(fds[1], F_GETFD);
+    if (flags == -1 || fcntl(fds[1], F_SETFD, flags & ~FD_CLOEXEC) == -1) {
+      LogErrno("fcntl(~FD_CLOEXEC)");
+      _exit(EXIT_FAILURE);
+    }
+    char fd_str[16];
+    snprintf(fd_str, sizeof(fd_str), "%d", fds[1]);
+    setenv("XSECURELOCK_PRESTAGE_FD", fd_str, 1);
+    execvp(locker_argv[0], locker_argv);
+    LogErrno("execvp");
+    _exit(EXIT_FAILURE);
+  }
+  close(fds[1]);
+  return fds[0];
+}
+
+/*! \brief Sends a byte to the other side.
+ *
+ * Unlike write, this does not raise SIGPIPE if the other side is gone, which
+ * the dimming tools do not ignore.
+ *
+ * \return 1 on success, 0 if the other side is gone, -1 on other errors.
+ */
+static int SendByte(int prestage_fd, char c) {
+  for (;;) {
+    if (send(prestage_fd, &c, 1, MSG_NOSIGNAL) == 1) {
+      return 1;
+    }
+    if (errno == EPIPE || errno == ECONNRESET) {
+      return 0;
+    }
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+}
+
+int CommitPrestagedLocker(int prestage_fd) {
+  char c = 'L';
+  int sent = SendByte(prestage_fd, c);
+  if (sent == 0) {
+    Log("Locker exited without locking");
+    return 0;
+  }
+  if (sent < 0) {
+    LogErrno("send(prestage_fd)");
+    return 0;
+  }
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  for (;;) {
+    int elapsed_ms = (int)MillisecondsSince(&start);
+    if (elapsed_ms >= COMMIT_TIMEOUT_MS) {
+      // The locker got the commit and keeps going, so we cannot take it back;
+      // starting another locker or dimming on would only get in its way.
+      Log("Locker did not confirm the lock within %d ms - assuming it locked",
+          COMMIT_TIMEOUT_MS);
+      return 1;
+    }
+    struct pollfd pfd;
+    pfd.fd = prestage_fd;
+    pfd.events = POLLIN;
+    int ready = poll(&pfd, 1, (int)(COMMIT_TIMEOUT_MS - elapsed_ms));
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LogErrno("poll(prestage_fd)");
+      return 0;
+    }
+    if (ready == 0) {
+      continue;  // Timed out; handled above.
+    }
+    ssize_t got = read(prestage_fd, &c, 1);
+    if (got == 1) {
+      return 1;
+    }
+    if (got == 0) {
+      Log("Locker exited without locking");
+      return 0;
+    }
+    if (errno != EINTR) {
+      LogErrno("read(prestage_fd)");
+      return 0;
+    }
+  }
+}
+
+int WaitForPrestageCommit(int prestage_fd) {
+  for (;;) {
+    char c;
+    ssize_t got = read(prestage_fd, &c, 1);
+    if (got == 1) {
+      return 1;
+    }
+    if (got == 0) {
+      return 0;
+    }
+    if (errno != EINTR) {
+      LogErrno("read(XSECURELOCK_PRESTAGE_FD)");
+      return 0;
+    }
+  }
+}
+
+void ConfirmPrestagedLock(int prestage_fd) {
+  // If whoever pre-staged us is gone, there is nobody left to tell.
+  if (SendByte(prestage_fd, 'L') < 0) {
+    LogErrno("send(XSECURELOCK_PRESTAGE_FD)");
+  }
+  if (close(prestage_fd) != 0) {
+    LogErrno("close(XSECURELOCK_PRESTAGE_FD)");
+  }
+}
@@ -0,0 +1,61 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef PRESTAGE_H
+#define PRESTAGE_H
+
+#include <sys/types.h>  // for pid_t
+
+/*! \brief Starts the locker in pre-staged mode.
+ *
+ * The locker gets one end of a socket pair passed in XSECURELOCK_PRESTAGE_FD.
+ * Writing a byte to the socket commits the lock; the locker answers with a
+ * byte once the screen is locked. Closing the socket aborts the lock.
+ *
+ * \param lockerpid Receives the process group ID of the locker.
+ * \return Our end of the socket pair, or -1 on failure.
+ */
+int StartPrestagedLocker(char **locker_argv, pid_t *lockerpid);
+
+/*! \brief Tells the pre-staged locker to lock, and waits until it did.
+ *
+ * The wait is limited to a few seconds. If the locker is still running by then
+ * without having confirmed the lock, it counts as locked anyway: it cannot be
+ * told to abort anymore, so the caller must treat it as the active locker.
+ *
+ * \return 1 if the locker confirmed the lock or timed out confirming it, 0 if
+ *   it exited without locking.
+ */
+int CommitPrestagedLocker(int prestage_fd);
+
+/*! \brief Waits until whoever pre-staged us tells us to lock.
+ *
+ * This is the locker side of CommitPrestagedLocker.
+ *
+ * \param prestage_fd The socket from XSECURELOCK_PRESTAGE_FD.
+ * \return 1 if we should lock now, 0 if the lock got aborted.
+ */
+int WaitForPrestageCommit(int prestage_fd);
+
+/*! \brief Tells whoever pre-staged us that the screen is locked now.
+ *
+ * Also closes the socket, as there is nothing more to say.
+ *
+ * \param prestage_fd The socket from XSECURELOCK_PRESTAGE_FD.
+ */
+void ConfirmPrestagedLock(int prestage_fd);
+
+#endif
@@ -0,0 +1,380 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief Clock saver.
+ *
+ *Shows the time, and optionally the hostname and battery level, on the
+ *XSCREENSAVER_WINDOW.
+ *
+ *To use as little CPU as possible, this wakes up only when the shown text can
+ *change (i.e. at the next second or minute boundary, depending on the time
+ *format), and then only redraws the part of each line that changed. Against
+ *burn-in, the text moves to a new random position every few minutes.
+ */
+
+#include <X11/X.h>       // for Window, ExposureMask
+#include <X11/Xlib.h>    // for XDrawString, XFillRectangle, XLoadQueryFont
+#include <dirent.h>      // for closedir, opendir, readdir, DIR, dirent
+#include <errno.h>       // for errno, EINTR
+#include <stdio.h>       // for snprintf, fopen, fgets, fclose
+#include <stdlib.h>      // for rand, srand
+#include <string.h>      // for strcmp, strlen, strcspn, strstr, memcpy
+#include <sys/select.h>  // for select, FD_SET, FD_ZERO, fd_set
+#include <sys/time.h>    // for gettimeofday, timeval
+#include <time.h>        // for localtime_r, strftime, time_t
+#include <unistd.h>      // for gethostname
+
+#ifdef HAVE_XFT_EXT
+#include <X11/Xft/Xft.h>  // for XftDrawStringUtf8, XftFontOpenName
+#endif
+
+#include "../env_settings.h"      // for GetIntSetting, GetStringSetting
+#include "../logging.h"           // for Log, LogErrno
+#include "../xscreensaver_api.h"  // for ReadWindowID
+
+//! Number of lines shown at most: time, hostname and battery.
+#define MAX_LINES 3
+
+//! Maximum length of a line.
+#define MAX_LINE 256
+
+//! Extra delay after a second boundary, so the new second has surely begun.
+#define TICK_SLACK_US 5000
+
+static Display *display;
+static Window window;
+static int width, height;
+static GC gc_foreground, gc_background;
+static XFontStruct *core_font;
+#ifdef HAVE_XFT_EXT
+static XftFont *xft_font;
+static XftDraw *xft_draw;
+static XftColor xft_color;
+#endif
+
+static const char *time_format;
+static int show_hostname;
+static int show_battery;
+static int move_seconds;
+
+//! The currently shown lines.
+static char lines[MAX_LINES][MAX_LINE];
+static int num_lines;
+//! Position of the text block.
+static int block_x, block_y;
+static int line_height, ascent;
+
+static int TextWidth(const char *string, int len) {
+#ifdef HAVE_XFT_EXT
+  if (xft_font != NULL) {
+    XGlyphInfo extents;
+    XftTextExtentsUtf8(display, xft_font, (const FcChar8 *)string, len,
+                       &extents);
+    return extents.xOff;
+  }
+#endif
+  return XTextWidth(core_font, string, len);
+}
+
+static void DrawString(int x, int y, const char *string, int len) {
+#ifdef HAVE_XFT_EXT
+  if (xft_font != NULL) {
+    XftDrawStringUtf8(xft_draw, &xft_color, xft_font, x, y,
+                      (const FcChar8 *)string, len);
+    return;
+  }
+#endif
+  XDrawString(display, window, gc_foreground, x, y, string, len);
+}
+
+/*! \brief Returns whether the time format shows seconds.
+ */
+static int FormatHasSeconds(const char *format) {
+  static const char *const seconds_specs[] = {"%S", "%T", "%s", "%r", "%c",
+                                              "%X", "%+", NULL};
+  for (const char *const *spec = seconds_specs; *spec != NULL; ++spec) {
+    if (strstr(format, *spec) != NULL) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*! \brief Reads the battery level from sysfs.
+ *
+ * \return 0 if a battery was found.
+ */
+static int GetBatteryLine(char *buf, size_t bufsize) {
+  static const char *const dirname = "/sys/class/power_supply";
+  DIR *dir = opendir(dirname);
+  if (dir == NULL) {
+    return -1;
+  }
+  int found = -1;
+  struct dirent *de;
+  while (found != 0 && (de = readdir(dir)) != NULL) {
+    if (de->d_name[0] == '.') {
+      continue;
+    }
+    char path[512];
+    char type[32], capacity[32], status[32];
+    snprintf(path, sizeof(path), "%s/%s/type", dirname, de->d_name);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+      continue;
+    }
+    int ok = fgets(type, sizeof(type), f) != NULL;
+    fclose(f);
+    if (!ok || strncmp(type, "Battery", 7)) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s/capacity", dirname, de->d_name);
+    f = fopen(path, "r");
+    if (f == NULL) {
+      continue;
+    }
+    ok = fgets(capacity, sizeof(capacity), f) != NULL;
+    fclose(f);
+    if (!ok) {
+      continue;
+    }
+    capacity[strcspn(capacity, "\n")] = 0;
+    status[0] = 0;
+    snprintf(path, sizeof(path), "%s/%s/status", dirname, de->d_name);
+    f = fopen(path, "r");
+    if (f != NULL) {
+      if (fgets(status, sizeof(status), f) == NULL) {
+        status[0] = 0;
+      }
+      fclose(f);
+    }
+    snprintf(buf, bufsize, "Battery %s%%%s", capacity,
+             strncmp(status, "Charging", 8) ? "" : " (charging)");
+    found = 0;
+  }
+  closedir(dir);
+  return found;
+}
+
+/*! \brief Computes the lines to show at the given time.
+ */
+static int ComputeLines(time_t now, char new_lines[MAX_LINES][MAX_LINE]) {
+  int n = 0;
+  struct tm tm;
+  localtime_r(&now, &tm);
+  if (strftime(new_lines[n], MAX_LINE, time_format, &tm) == 0) {
+    new_lines[n][0] = 0;
+  }
+  ++n;
+  if (show_hostname) {
+    char hostname[MAX_LINE];
+    if (gethostname(hostname, sizeof(hostname)) == 0) {
+      hostname[sizeof(hostname) - 1] = 0;
+      if (show_hostname == 1) {
+        hostname[strcspn(hostname, ".")] = 0;
+      }
+      memcpy(new_lines[n++], hostname, sizeof(hostname));
+    }
+  }
+  if (show_battery) {
+    if (GetBatteryLine(new_lines[n], MAX_LINE) == 0) {
+      ++n;
+    }
+  }
+  return n;
+}
+
+static int BlockWidth(char block_lines[MAX_LINES][MAX_LINE], int n) {
+  int w = 0;
+  for (int i = 0; i < n; ++i) {
+    int lw = TextWidth(block_lines[i], strlen(block_lines[i]));
+    if (lw > w) {
+      w = lw;
+    }
+  }
+  return w;
+}
+
+/*! \brief Moves the text block to a new random position and redraws all.
+ */
+static void MoveBlock(char new_lines[MAX_LINES][MAX_LINE], int n) {
+  XFillRectangle(display, window, gc_background, 0, 0, width, height);
+  // Leave room for the text to grow a bit, e.g. from "1:11" to "20:00".
+  int w = BlockWidth(new_lines, n) * 5 / 4;
+  int h = n * line_height;
+  block_x = w < width ? rand() % (width - w + 1) : 0;
+  block_y = h < height ? rand() % (height - h + 1) : 0;
+  for (int i = 0; i < n; ++i) {
+    DrawString(block_x, block_y + i * line_height + ascent, new_lines[i],
+               strlen(new_lines[i]));
+    memcpy(lines[i], new_lines[i], MAX_LINE);
+  }
+  num_lines = n;
+}
+
+/*! \brief Redraws only the changed part of each line.
+ *
+ * The lines are left aligned, so the unchanged prefix of a line stays put.
+ */
+static void UpdateLines(char new_lines[MAX_LINES][MAX_LINE], int n) {
+  if (n != num_lines) {
+    MoveBlock(new_lines, n);
+    return;
+  }
+  for (int i = 0; i < n; ++i) {
+    if (!strcmp(lines[i], new_lines[i])) {
+      continue;
+    }
+    size_t prefix = 0;
+    while (lines[i][prefix] && lines[i][prefix] == new_lines[i][prefix]) {
+      ++prefix;
+    }
+    // Don't split UTF-8 sequences.
+    while (prefix > 0 && (new_lines[i][prefix] & 0xC0) == 0x80) {
+      --prefix;
+    }
+    int x = block_x + TextWidth(new_lines[i], prefix);
+    int old_width = TextWidth(lines[i], strlen(lines[i]));
+    int new_width = TextWidth(new_lines[i], strlen(new_lines[i]));
+    int right = block_x + (old_width > new_width ? old_width : new_width);
+    // Glyphs may overhang their advance a little; clear a bit more.
+    int overhang = line_height / 4;
+    XFillRectangle(display, window, gc_background, x, block_y + i * line_height,
+                   right - x + overhang, line_height);
+    DrawString(x, block_y + i * line_height + ascent, new_lines[i] + prefix,
+               strlen(new_lines[i] + prefix));
+    memcpy(lines[i], new_lines[i], MAX_LINE);
+  }
+}
+
+static int LoadFont(void) {
+  const char *font_name =
+      GetStringSetting("XSECURELOCK_CLOCK_FONT", "monospace:size=48");
+  core_font = XLoadQueryFont(display, font_name);
+#ifdef HAVE_XFT_EXT
+  if (core_font == NULL) {
+    xft_font = XftFontOpenName(display, DefaultScreen(display), font_name);
+  }
+  if (xft_font != NULL) {
+    XWindowAttributes xwa;
+    XGetWindowAttributes(display, window, &xwa);
+    xft_draw = XftDrawCreate(display, window, xwa.visual, xwa.colormap);
+    XRenderColor xrcolor = {65535, 65535, 65535, 65535};
+    XftColorAllocValue(display, xwa.visual, xwa.colormap, &xrcolor,
+                       &xft_color);
+    line_height = xft_font->ascent + xft_font->descent;
+    ascent = xft_font->ascent;
+    return 0;
+  }
+#endif
+  if (core_font == NULL) {
+    Log("Could not load the specified font %s - trying a default font",
+        font_name);
+    core_font = XLoadQueryFont(display, "fixed");
+  }
+  if (core_font == NULL) {
+    Log("Could not load a mind-bogglingly stupid font");
+    return -1;
+  }
+  XSetFont(display, gc_foreground, core_font->fid);
+  line_height = core_font->ascent + core_font->descent;
+  ascent = core_font->ascent;
+  return 0;
+}
+
+int main() {
+  if ((display = XOpenDisplay(NULL)) == NULL) {
+    Log("Could not connect to $DISPLAY");
+    return 1;
+  }
+  window = ReadWindowID();
+  if (window == None) {
+    Log("Invalid/no window ID in XSCREENSAVER_WINDOW");
+    return 1;
+  }
+  XWindowAttributes xwa;
+  if (!XGetWindowAttributes(display, window, &xwa)) {
+    Log("Could not get attributes of XSCREENSAVER_WINDOW");
+    return 1;
+  }
+  width = xwa.width;
+  height = xwa.height;
+
+  time_format = GetStringSetting("XSECURELOCK_CLOCK_FORMAT", "%H:%M");
+  show_hostname = GetIntSetting("XSECURELOCK_CLOCK_SHOW_HOSTNAME", 0);
+  show_battery = GetIntSetting("XSECURELOCK_CLOCK_SHOW_BATTERY", 0);
+  move_seconds = GetIntSetting("XSECURELOCK_CLOCK_MOVE_MINUTES", 5) * 60;
+  int period = FormatHasSeconds(time_format) ? 1 : 60;
+
+  XGCValues gcattrs;
+  gcattrs.foreground = WhitePixel(display, DefaultScreen(display));
+  gcattrs.background = BlackPixel(display, DefaultScreen(display));
+  gc_foreground =
+      XCreateGC(display, window, GCForeground | GCBackground, &gcattrs);
+  gcattrs.foreground = gcattrs.background;
+  gc_background = XCreateGC(display, window, GCForeground, &gcattrs);
+  if (LoadFont()) {
+    return 1;
+  }
+  XSelectInput(display, window, ExposureMask);
+
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  srand(tv.tv_sec ^ tv.tv_usec);
+  char new_lines[MAX_LINES][MAX_LINE];
+  MoveBlock(new_lines, ComputeLines(tv.tv_sec, new_lines));
+  time_t last_move = tv.tv_sec;
+  XFlush(display);
+
+  int x11_fd = ConnectionNumber(display);
+  for (;;) {
+    // Sleep until the next second or minute boundary.
+    gettimeofday(&tv, NULL);
+    long long now_us = tv.tv_sec * 1000000LL + tv.tv_usec;
+    long long period_us = period * 1000000LL;
+    long long wait_us = period_us - now_us % period_us + TICK_SLACK_US;
+    struct timeval timeout;
+    timeout.tv_sec = wait_us / 1000000;
+    timeout.tv_usec = wait_us % 1000000;
+    fd_set in_fds;
+    FD_ZERO(&in_fds);
+    FD_SET(x11_fd, &in_fds);
+    if (select(x11_fd + 1, &in_fds, NULL, NULL, &timeout) == -1 &&
+        errno != EINTR) {
+      LogErrno("select");
+      return 1;
+    }
+
+    gettimeofday(&tv, NULL);
+    int n = ComputeLines(tv.tv_sec, new_lines);
+    int exposed = 0;
+    while (XPending(display)) {
+      XEvent ev;
+      XNextEvent(display, &ev);
+      if (ev.type == Expose && ev.xexpose.count == 0) {
+        exposed = 1;
+      }
+    }
+    if (exposed || (move_seconds > 0 && tv.tv_sec - last_move >= move_seconds)) {
+      MoveBlock(new_lines, n);
+      last_move = tv.tv_sec;
+    } else {
+      UpdateLines(new_lines, n);
+    }
+    XFlush(display);
+  }
+}
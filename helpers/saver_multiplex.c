@@ -14,22 +14,22 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
-#include <X11/X.h>       // for Window, CopyFromParent, CWBackPixel
-#include <X11/Xlib.h>    // for XEvent, XFlush, XNextEvent, XOpenDi...
+#include <X11/X.h>       // for Window, None
+#include <X11/Xlib.h>    // for XEvent, XNextEvent, XOpenDisplay, XP...
 #include <signal.h>      // for signal, SIGTERM
-#include <stdio.h>       // for fprintf, NULL, stderr
+#include <stdio.h>       // for NULL
 #include <stdlib.h>      // for setenv
-#include <string.h>      // for memcmp, memcpy
 #include <sys/select.h>  // for select, FD_SET, FD_ZERO, fd_set
+#include <sys/time.h>    // for timeval
 #include <unistd.h>      // for sleep
 
-#include "../env_settings.h"      // for GetStringSetting
+#include "../env_settings.h"      // for GetIntSetting, GetExecutablePat...
 #include "../logging.h"           // for Log, LogErrno
-#include "../saver_child.h"       // for MAX_SAVERS
+#include "../saver_child.h"       // for KillAllSaverChildrenSigHandler
 #include "../wait_pgrp.h"         // for InitWaitPgrp
-#include "../wm_properties.h"     // for SetWMProperties
 #include "../xscreensaver_api.h"  // for ReadWindowID
-#include "monitors.h"             // for IsMonitorChangeEvent, Monitor, Sele...
+#include "monitors.h"             // for IsMonitorChangeEvent, MonitorChange...
+#include "multiplex.h"            // for InitMultiplex, MultiplexTimeoutMs, ...
 
 static void HandleSIGUSR1(int signo) {
   KillAllSaverChildrenSigHandler(signo);  // Dirty, but quick.
@@ -40,43 +40,6 @@ static void HandleSIGTERM(int signo) {
   raise(signo);                           // Destroys windows we created anyway.
 }
 
-#define MAX_MONITORS MAX_SAVERS
-
-static const char* saver_executable;
-
-static Display* display;
-static Monitor monitors[MAX_MONITORS];
-static size_t num_monitors;
-static Window windows[MAX_MONITORS];
-
-static void WatchSavers(void) {
-  for (size_t i = 0; i < num_monitors; ++i) {
-    WatchSaverChild(display, windows[i], i, saver_executable, 1);
-  }
-}
-
-static void SpawnSavers(Window parent, int argc, char* const* argv) {
-  for (size_t i = 0; i < num_monitors; ++i) {
-    windows[i] =
-        XCreateWindow(display, parent, monitors[i].x, monitors[i].y,
-                      monitors[i].width, monitors[i].height, 0, CopyFromParent,
-                      InputOutput, CopyFromParent, 0, NULL);
-    SetWMProperties(display, windows[i], "xsecurelock",
-                    "saver_multiplex_screen", argc, argv);
-    XMapRaised(display, windows[i]);
-  }
-  // Need to flush the display so savers sure can access the window.
-  XFlush(display);
-  WatchSavers();
-}
-
-static void KillSavers(void) {
-  for (size_t i = 0; i < num_monitors; ++i) {
-    WatchSaverChild(display, windows[i], i, saver_executable, 0);
-    XDestroyWindow(display, windows[i]);
-  }
-}
-
 /*! \brief The main program.
  *
  * Usage: XSCREENSAVER_WINDOW=window_id ./saver_multiplex
@@ -93,7 +56,8 @@ int main(int argc, char** argv) {
   }
   setenv("XSECURELOCK_INSIDE_SAVER_MULTIPLEX", "1", 1);
 
-  if ((display = XOpenDisplay(NULL)) == NULL) {
+  Display* display = XOpenDisplay(NULL);
+  if (display == NULL) {
     Log("Could not connect to $DISPLAY");
     return 1;
   }
@@ -105,13 +69,12 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  saver_executable =
+  const char* saver_executable =
       GetExecutablePathSetting("XSECURELOCK_SAVER", SAVER_EXECUTABLE, 0);
 
   SelectMonitorChangeEvents(display, parent);
-  num_monitors = GetMonitors(display, parent, monitors, MAX_MONITORS);
-
-  SpawnSavers(parent, argc, argv);
+  InitMultiplex(display, parent, saver_executable, argc, argv);
+  WatchMultiplexedSavers(1);
 
   struct sigaction sa;
   sigemptyset(&sa.sa_mask);
@@ -128,27 +91,34 @@ int main(int argc, char** argv) {
 
   InitWaitPgrp();
 
+  MonitorChangeSettle monitor_change_settle = {0};
   for (;;) {
     fd_set in_fds;
     FD_ZERO(&in_fds);
     FD_SET(x11_fd, &in_fds);
-    select(x11_fd + 1, &in_fds, 0, 0, NULL);
-    WatchSavers();
+    // Wake up when pending monitor changes have settled, to check on savers
+    // that are terminating, or to start the next saver.
+    int timeout_ms = MonitorChangeSettleTimeoutMs(&monitor_change_settle);
+    int saver_timeout_ms = MultiplexTimeoutMs();
+    if (saver_timeout_ms >= 0 &&
+        (timeout_ms < 0 || saver_timeout_ms < timeout_ms)) {
+      timeout_ms = saver_timeout_ms;
+    }
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    select(x11_fd + 1, &in_fds, 0, 0, timeout_ms < 0 ? NULL : &tv);
+    WatchMultiplexedSavers(1);
     XEvent ev;
     while (XPending(display) && (XNextEvent(display, &ev), 1)) {
-      if (IsMonitorChangeEvent(display, ev.type)) {
-        Monitor new_monitors[MAX_SAVERS];
-        size_t new_num_monitors =
-            GetMonitors(display, parent, new_monitors, MAX_SAVERS);
-        if (new_num_monitors != num_monitors ||
-            memcmp(new_monitors, monitors, sizeof(monitors)) != 0) {
-          KillSavers();
-          num_monitors = new_num_monitors;
-          memcpy(monitors, new_monitors, sizeof(monitors));
-          SpawnSavers(parent, argc, argv);
-        }
+      if (IsMonitorChangeEvent(display, &ev)) {
+        NoteMonitorChange(&monitor_change_settle);
       }
     }
+    // Only respawn savers once per burst of changes.
+    if (MonitorChangeSettled(&monitor_change_settle)) {
+      UpdateMultiplexedMonitors();
+    }
   }
 
   return 0;
@@ -0,0 +1,572 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief Image slideshow saver.
+ *
+ *Shows still images picked by media_catalog, scaled to fit the
+ *XSCREENSAVER_WINDOW. The next image is decoded and scaled on a background
+ *thread while the current one is shown; between transitions, the process
+ *sleeps.
+ *
+ *Reads JPEG (if built with libjpeg) and binary PPM images. Other formats are
+ *shown once media_catalog has pre-scaled them to JPEG.
+ */
+
+#include <X11/X.h>       // for Window, ExposureMask, ZPixmap
+#include <X11/Xlib.h>    // for XOpenDisplay, XCreateImage, XPutImage
+#include <X11/Xutil.h>   // for XPutPixel, XDestroyImage
+#include <errno.h>       // for errno, EINTR
+#include <pthread.h>     // for pthread_create, pthread_mutex_lock
+#include <stdint.h>      // for uint32_t
+#include <stdio.h>       // for fopen, fclose, fread, getc, popen
+#include <stdlib.h>      // for malloc, free, realloc
+#include <string.h>      // for memcpy, strrchr, strlen, strdup
+#include <strings.h>     // for strcasecmp
+#include <sys/select.h>  // for select, FD_SET, FD_ZERO, fd_set
+#include <sys/time.h>    // for gettimeofday, timeval
+#include <unistd.h>      // for pipe, read, write, sleep, execl
+
+#ifdef HAVE_XSHM_EXT
+#include <X11/extensions/XShm.h>  // for XShmCreateImage, XShmPutImage
+#include <sys/ipc.h>              // for IPC_CREAT, IPC_PRIVATE, IPC_RMID
+#include <sys/shm.h>              // for shmat, shmctl, shmdt, shmget
+#endif
+
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>  // for jpeg_decompress_struct, jpeg_read_scanlines
+#include <setjmp.h>   // for jmp_buf, longjmp, setjmp
+#endif
+
+#include "../env_settings.h"      // for GetIntSetting
+#include "../logging.h"           // for Log, LogErrno
+#include "../xscreensaver_api.h"  // for ReadWindowID
+#include "image_scale.h"          // for FitImageSize, ScaleImageRGB
+
+//! How many images to ask media_catalog for at once.
+#define PLAYLIST_SIZE 256
+
+//! How long to wait before asking again when no image could be shown.
+#define RETRY_SECONDS 10
+
+static Display *display;
+static Window window;
+static int width, height;
+static GC gc;
+static XImage *ximage;
+#ifdef HAVE_XSHM_EXT
+static XShmSegmentInfo shminfo;
+static int use_shm;
+#endif
+
+//! Protects next_frame_ready.
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+//! Signaled when next_frame_ready gets cleared.
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+//! The next image to show; owned by the decoder while !next_frame_ready.
+static uint32_t *next_frame;
+static int next_frame_ready;
+//! The decoder writes a byte here when next_frame becomes ready.
+static int ready_pipe[2];
+
+//! A decoded image, 3 bytes (R, G, B) per pixel.
+struct Image {
+  unsigned char *pixels;
+  int width, height;
+};
+
+static int ReadPPMNumber(FILE *f) {
+  int c;
+  // Skip whitespace and comments.
+  for (;;) {
+    c = getc(f);
+    if (c == '#') {
+      while (c != '\n' && c != EOF) {
+        c = getc(f);
+      }
+    } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+      break;
+    }
+  }
+  int n = 0;
+  while (c >= '0' && c <= '9') {
+    if (n > 100000) {
+      return -1;
+    }
+    n = n * 10 + (c - '0');
+    c = getc(f);
+  }
+  // The single whitespace character after the number was consumed by now.
+  return n;
+}
+
+static int DecodePPM(FILE *f, struct Image *img) {
+  if (getc(f) != 'P' || getc(f) != '6') {
+    return -1;
+  }
+  img->width = ReadPPMNumber(f);
+  img->height = ReadPPMNumber(f);
+  int maxval = ReadPPMNumber(f);
+  if (img->width <= 0 || img->height <= 0 || maxval <= 0 || maxval > 255) {
+    return -1;
+  }
+  size_t size = (size_t)img->width * img->height * 3;
+  img->pixels = malloc(size);
+  if (img->pixels == NULL) {
+    return -1;
+  }
+  if (fread(img->pixels, 1, size, f) != size) {
+    free(img->pixels);
+    return -1;
+  }
+  if (maxval != 255) {
+    for (size_t i = 0; i < size; ++i) {
+      img->pixels[i] = img->pixels[i] * 255 / maxval;
+    }
+  }
+  return 0;
+}
+
+#ifdef HAVE_LIBJPEG
+struct JPEGError {
+  struct jpeg_error_mgr mgr;
+  jmp_buf jmp;
+};
+
+static void JPEGErrorExit(j_common_ptr cinfo) {
+  longjmp(((struct JPEGError *)cinfo->err)->jmp, 1);
+}
+
+static void JPEGOutputMessage(j_common_ptr cinfo) {
+  (void)cinfo;  // Corrupt images are common enough to not log about them.
+}
+
+/*! \brief Decodes a JPEG image.
+ *
+ * Lets libjpeg downscale by up to 8x while decoding, as long as the result
+ * stays larger than what will be shown, which saves most of the work for
+ * large photos.
+ */
+static int DecodeJPEG(FILE *f, struct Image *img) {
+  struct jpeg_decompress_struct cinfo;
+  struct JPEGError err;
+  cinfo.err = jpeg_std_error(&err.mgr);
+  err.mgr.error_exit = JPEGErrorExit;
+  err.mgr.output_message = JPEGOutputMessage;
+  img->pixels = NULL;
+  if (setjmp(err.jmp)) {
+    jpeg_destroy_decompress(&cinfo);
+    free(img->pixels);
+    return -1;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, f);
+  jpeg_read_header(&cinfo, TRUE);
+  int fit_width, fit_height;
+  FitImageSize(cinfo.image_width, cinfo.image_height, width, height,
+               &fit_width, &fit_height);
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = 1;
+  for (unsigned int denom = 8; denom > 1; denom /= 2) {
+    if (cinfo.image_width / denom >= (unsigned int)fit_width &&
+        cinfo.image_height / denom >= (unsigned int)fit_height) {
+      cinfo.scale_denom = denom;
+      break;
+    }
+  }
+  cinfo.out_color_space = JCS_RGB;
+  jpeg_start_decompress(&cinfo);
+  if (cinfo.output_components != 3) {
+    longjmp(err.jmp, 1);
+  }
+  img->width = cinfo.output_width;
+  img->height = cinfo.output_height;
+  size_t row_size = (size_t)img->width * 3;
+  img->pixels = malloc(row_size * img->height);
+  if (img->pixels == NULL) {
+    longjmp(err.jmp, 1);
+  }
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = img->pixels + row_size * cinfo.output_scanline;
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return 0;
+}
+#endif
+
+static int HasExtension(const char *path, const char *const *extensions) {
+  const char *ext = strrchr(path, '.');
+  if (ext == NULL || strchr(ext, '/') != NULL) {
+    return 0;
+  }
+  for (const char *const *e = extensions; *e != NULL; ++e) {
+    if (!strcasecmp(ext, *e)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static const char *const ppm_extensions[] = {".ppm", ".pnm", NULL};
+#ifdef HAVE_LIBJPEG
+static const char *const jpeg_extensions[] = {".jpeg", ".jpg", NULL};
+#endif
+
+static int IsSupported(const char *path) {
+#ifdef HAVE_LIBJPEG
+  if (HasExtension(path, jpeg_extensions)) {
+    return 1;
+  }
+#endif
+  return HasExtension(path, ppm_extensions);
+}
+
+/*! \brief Decodes an image and scales it into next_frame, centered.
+ */
+static int LoadFrame(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    return -1;
+  }
+  struct Image img;
+  int ret;
+#ifdef HAVE_LIBJPEG
+  if (HasExtension(path, jpeg_extensions)) {
+    ret = DecodeJPEG(f, &img);
+  } else
+#endif
+  {
+    ret = DecodePPM(f, &img);
+  }
+  fclose(f);
+  if (ret != 0) {
+    return -1;
+  }
+  int fit_width, fit_height;
+  FitImageSize(img.width, img.height, width, height, &fit_width, &fit_height);
+  int x = (width - fit_width) / 2;
+  int y = (height - fit_height) / 2;
+  memset(next_frame, 0, (size_t)width * height * sizeof(*next_frame));
+  ret = ScaleImageRGB(img.pixels, img.width, img.height,
+                      next_frame + (size_t)y * width + x, fit_width,
+                      fit_height, width);
+  free(img.pixels);
+  return ret;
+}
+
+/*! \brief Asks media_catalog for images to show.
+ *
+ * \return The number of images in *paths.
+ */
+static size_t ReadPlaylist(char ***paths) {
+  size_t num_paths = 0;
+  *paths = malloc(PLAYLIST_SIZE * sizeof(**paths));
+  if (*paths == NULL) {
+    return 0;
+  }
+  FILE *f = popen("./media_catalog -p 256", "r");
+  if (f == NULL) {
+    LogErrno("popen media_catalog");
+    return 0;
+  }
+  char line[8192];
+  while (num_paths < PLAYLIST_SIZE && fgets(line, sizeof(line), f) != NULL) {
+    size_t len = strlen(line);
+    if (len < 2 || line[len - 1] != '\n') {
+      continue;
+    }
+    line[len - 1] = 0;
+    if (!IsSupported(line)) {
+      continue;
+    }
+    char *path = strdup(line);
+    if (path != NULL) {
+      (*paths)[num_paths++] = path;
+    }
+  }
+  pclose(f);
+  return num_paths;
+}
+
+static void *DecoderThread(void *arg) {
+  (void)arg;
+  char **paths = NULL;
+  size_t num_paths = 0, next_path = 0, num_shown = 0;
+  for (;;) {
+    pthread_mutex_lock(&mutex);
+    while (next_frame_ready) {
+      pthread_cond_wait(&cond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (next_path == num_paths) {
+      for (size_t i = 0; i < num_paths; ++i) {
+        free(paths[i]);
+      }
+      free(paths);
+      if (num_paths != 0 && num_shown == 0) {
+        Log("None of %d images could be shown", (int)num_paths);
+      }
+      if (num_shown == 0) {
+        sleep(RETRY_SECONDS);
+      }
+      num_paths = ReadPlaylist(&paths);
+      next_path = 0;
+      num_shown = 0;
+      continue;
+    }
+
+    if (LoadFrame(paths[next_path++])) {
+      continue;
+    }
+    ++num_shown;
+    pthread_mutex_lock(&mutex);
+    next_frame_ready = 1;
+    pthread_mutex_unlock(&mutex);
+    while (write(ready_pipe[1], "", 1) == -1 && errno == EINTR) {
+    }
+  }
+  return NULL;
+}
+
+#ifdef HAVE_XSHM_EXT
+static int shm_error;
+
+static int HandleShmError(Display *dpy, XErrorEvent *ev) {
+  (void)dpy;
+  (void)ev;
+  shm_error = 1;
+  return 0;
+}
+
+/*! \brief Creates the XImage in shared memory, if possible.
+ */
+static XImage *CreateShmImage(Visual *visual, int depth) {
+  if (!XShmQueryExtension(display)) {
+    return NULL;
+  }
+  XImage *image = XShmCreateImage(display, visual, depth, ZPixmap, NULL,
+                                  &shminfo, width, height);
+  if (image == NULL) {
+    return NULL;
+  }
+  shminfo.shmid = shmget(IPC_PRIVATE, (size_t)image->bytes_per_line * height,
+                         IPC_CREAT | 0600);
+  if (shminfo.shmid == -1) {
+    XDestroyImage(image);
+    return NULL;
+  }
+  shminfo.shmaddr = image->data = shmat(shminfo.shmid, NULL, 0);
+  shminfo.readOnly = False;
+  int (*old_handler)(Display *, XErrorEvent *) =
+      XSetErrorHandler(HandleShmError);
+  shm_error = 0;
+  if (shminfo.shmaddr != (char *)-1) {
+    XShmAttach(display, &shminfo);
+    XSync(display, False);
+  }
+  XSetErrorHandler(old_handler);
+  // Mark for deletion now, so the segment is freed whenever we exit.
+  shmctl(shminfo.shmid, IPC_RMID, NULL);
+  if (shminfo.shmaddr == (char *)-1 || shm_error) {
+    // E.g. a remote X server.
+    if (shminfo.shmaddr != (char *)-1) {
+      shmdt(shminfo.shmaddr);
+    }
+    image->data = NULL;
+    XDestroyImage(image);
+    return NULL;
+  }
+  return image;
+}
+#endif
+
+static int MaskShift(unsigned long mask) {
+  int shift = 0;
+  while (mask > 0xFF) {
+    mask >>= 1;
+    ++shift;
+  }
+  while (mask != 0 && !(mask & 0x80)) {
+    mask <<= 1;
+    --shift;
+  }
+  return shift;
+}
+
+static unsigned long ShiftColor(uint32_t c, int shift) {
+  return shift >= 0 ? (unsigned long)c << shift : c >> -shift;
+}
+
+/*! \brief Copies next_frame into the XImage and shows it.
+ */
+static void ShowFrame(void) {
+  int one = 1;
+  int native_order = *(char *)&one ? LSBFirst : MSBFirst;
+  if (ximage->bits_per_pixel == 32 && ximage->red_mask == 0xFF0000 &&
+      ximage->green_mask == 0xFF00 && ximage->blue_mask == 0xFF &&
+      ximage->byte_order == native_order) {
+    for (int y = 0; y < height; ++y) {
+      memcpy(ximage->data + (size_t)y * ximage->bytes_per_line,
+             next_frame + (size_t)y * width, (size_t)width * 4);
+    }
+  } else {
+    int red_shift = MaskShift(ximage->red_mask);
+    int green_shift = MaskShift(ximage->green_mask);
+    int blue_shift = MaskShift(ximage->blue_mask);
+    for (int y = 0; y < height; ++y) {
+      const uint32_t *row = next_frame + (size_t)y * width;
+      for (int x = 0; x < width; ++x) {
+        uint32_t c = row[x];
+        XPutPixel(ximage, x, y,
+                  (ShiftColor((c >> 16) & 0xFF, red_shift) & ximage->red_mask) |
+                      (ShiftColor((c >> 8) & 0xFF, green_shift) &
+                       ximage->green_mask) |
+                      (ShiftColor(c & 0xFF, blue_shift) & ximage->blue_mask));
+      }
+    }
+  }
+}
+
+static void PutFrame(void) {
+#ifdef HAVE_XSHM_EXT
+  if (use_shm) {
+    XShmPutImage(display, window, gc, ximage, 0, 0, 0, 0, width, height,
+                 False);
+  } else
+#endif
+  {
+    XPutImage(display, window, gc, ximage, 0, 0, 0, 0, width, height);
+  }
+  XFlush(display);
+}
+
+static double Now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main() {
+  if ((display = XOpenDisplay(NULL)) == NULL) {
+    Log("Could not connect to $DISPLAY");
+    return 1;
+  }
+  window = ReadWindowID();
+  if (window == None) {
+    Log("Invalid/no window ID in XSCREENSAVER_WINDOW");
+    return 1;
+  }
+  XWindowAttributes xwa;
+  if (!XGetWindowAttributes(display, window, &xwa)) {
+    Log("Could not get attributes of XSCREENSAVER_WINDOW");
+    return 1;
+  }
+  if (xwa.visual->class != TrueColor) {
+    Log("Only TrueColor visuals are supported; showing a blank screen");
+    execl("./saver_blank", "./saver_blank", (char *)NULL);
+    LogErrno("execl ./saver_blank");
+    return 1;
+  }
+  width = xwa.width;
+  height = xwa.height;
+  double duration = GetIntSetting("XSECURELOCK_IMAGE_DURATION_SECONDS", 1);
+
+#ifdef HAVE_XSHM_EXT
+  ximage = CreateShmImage(xwa.visual, xwa.depth);
+  use_shm = ximage != NULL;
+#endif
+  if (ximage == NULL) {
+    ximage = XCreateImage(display, xwa.visual, xwa.depth, ZPixmap, 0, NULL,
+                          width, height, 32, 0);
+    if (ximage != NULL) {
+      ximage->data = malloc((size_t)ximage->bytes_per_line * height);
+    }
+  }
+  next_frame = malloc((size_t)width * height * sizeof(*next_frame));
+  if (ximage == NULL || ximage->data == NULL || next_frame == NULL) {
+    Log("Could not allocate %dx%d image", width, height);
+    return 1;
+  }
+  gc = XCreateGC(display, window, 0, NULL);
+  XSelectInput(display, window, ExposureMask);
+
+  if (pipe(ready_pipe) != 0) {
+    LogErrno("pipe");
+    return 1;
+  }
+  pthread_t decoder;
+  if (pthread_create(&decoder, NULL, DecoderThread, NULL) != 0) {
+    Log("Could not start the decoder thread");
+    return 1;
+  }
+
+  int x11_fd = ConnectionNumber(display);
+  int shown = 0, pending = 0;
+  double deadline = 0;
+  for (;;) {
+    fd_set in_fds;
+    FD_ZERO(&in_fds);
+    FD_SET(x11_fd, &in_fds);
+    FD_SET(ready_pipe[0], &in_fds);
+    // Only wake up for the next transition when the image is ready.
+    struct timeval tv, *timeout = NULL;
+    if (pending) {
+      double wait = deadline - Now();
+      if (wait < 0) {
+        wait = 0;
+      }
+      tv.tv_sec = (time_t)wait;
+      tv.tv_usec = (suseconds_t)((wait - tv.tv_sec) * 1000000);
+      timeout = &tv;
+    }
+    int nfds = (x11_fd > ready_pipe[0] ? x11_fd : ready_pipe[0]) + 1;
+    if (select(nfds, &in_fds, NULL, NULL, timeout) == -1 && errno != EINTR) {
+      LogErrno("select");
+      return 1;
+    }
+
+    while (XPending(display)) {
+      XEvent ev;
+      XNextEvent(display, &ev);
+      if (ev.type == Expose && ev.xexpose.count == 0 && shown) {
+        PutFrame();
+      }
+    }
+
+    if (FD_ISSET(ready_pipe[0], &in_fds)) {
+      char c;
+      if (read(ready_pipe[0], &c, 1) == 1) {
+        pending = 1;
+      }
+    }
+
+    if (pending && Now() >= deadline) {
+      // The decoder leaves next_frame alone until we clear next_frame_ready.
+      ShowFrame();
+      PutFrame();
+      shown = 1;
+      pending = 0;
+      deadline = Now() + duration;
+      pthread_mutex_lock(&mutex);
+      next_frame_ready = 0;
+      pthread_cond_signal(&cond);
+      pthread_mutex_unlock(&mutex);
+    }
+  }
+}
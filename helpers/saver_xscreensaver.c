@@ -0,0 +1,422 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief XScreenSaver hack runner.
+ *
+ *Selects an XScreenSaver hack according to the mode, selected and programs
+ *settings in ~/.xscreensaver, and runs it. When the hack exits (or is reset
+ *via SIGUSR1), the next one is selected.
+ *
+ *~/.xscreensaver is only parsed again if its modification time changed.
+ *
+ *Usage:
+ *  saver_xscreensaver [--list_savers|--list_all_savers]
+ */
+
+#include <X11/Xlib.h>       // for Bool
+#include <X11/Xresource.h>  // for XrmGetFileDatabase, XrmGetResource
+#include <dirent.h>         // for closedir, opendir, readdir, DIR, dirent
+#include <errno.h>          // for errno, EINTR
+#include <signal.h>         // for sigaction, signal, sig_atomic_t, SIGUSR1
+#include <stdio.h>          // for printf, snprintf, NULL
+#include <stdlib.h>         // for atol, exit, free, qsort, realloc, random
+#include <string.h>         // for strchr, strcmp, strcspn, strdup, strpbrk
+#include <sys/stat.h>       // for stat
+#include <sys/wait.h>       // for waitpid, WIFEXITED, WEXITSTATUS
+#include <time.h>           // for time
+#include <unistd.h>         // for access, execl, execv, fork, getppid
+
+#include "../env_settings.h"  // for GetStringSetting
+#include "../logging.h"       // for Log, LogErrno
+
+//! Characters that make a command line need a shell, like in XScreenSaver.
+#define SHELL_CHARS "\"'\\$`*?[]{}()<>;&|~#"
+
+struct Saver {
+  //! The index in the programs list.
+  int number;
+  //! Whether the saver is enabled.
+  int enabled;
+  //! The command line, with the program's full path.
+  char *command;
+};
+
+static const char *xscreensaver_path;
+
+static struct Saver *savers;
+static size_t num_savers, max_savers;
+
+//! Modification time of ~/.xscreensaver when it was loaded, or -1 if missing.
+static long long loaded_mtime = -2;
+
+static char *mode;
+static char *selected_setting;
+
+static volatile sig_atomic_t sigusr1_caught;
+
+static void HandleSIGUSR1(int signo) {
+  (void)signo;
+  sigusr1_caught = 1;
+}
+
+static char *StrDupOrDie(const char *s) {
+  char *copy = strdup(s);
+  if (copy == NULL) {
+    Log("Out of memory");
+    exit(1);
+  }
+  return copy;
+}
+
+/*! \brief Adds a saver, if its program is installed.
+ *
+ * \param program The program name followed by its flags.
+ */
+static void AddSaver(int number, int enabled, const char *program) {
+  size_t len = strcspn(program, " \t");
+  if (len == 0) {
+    return;
+  }
+  char command[4096];
+  if (snprintf(command, sizeof(command), "%s/%s", xscreensaver_path,
+               program) >= (int)sizeof(command)) {
+    return;
+  }
+  // Check just the program, without the flags.
+  size_t path_len = strlen(xscreensaver_path) + 1 + len;
+  char saved = command[path_len];
+  command[path_len] = 0;
+  int ok = access(command, X_OK) == 0;
+  command[path_len] = saved;
+  if (!ok) {
+    return;
+  }
+  if (num_savers == max_savers) {
+    max_savers = max_savers ? max_savers * 2 : 64;
+    savers = realloc(savers, max_savers * sizeof(*savers));
+    if (savers == NULL) {
+      Log("Out of memory");
+      exit(1);
+    }
+  }
+  savers[num_savers].number = number;
+  savers[num_savers].enabled = enabled;
+  savers[num_savers].command = StrDupOrDie(command);
+  ++num_savers;
+}
+
+/*! \brief Parses one line of the programs setting.
+ *
+ * Note: the following logic is somewhat derived from parse_screenhack in
+ * XScreenSaver.
+ */
+static void ParseProgram(int number, char *line) {
+  line += strspn(line, " \t");
+  // Read disabled field.
+  int enabled = 1;
+  if (*line == '-') {
+    enabled = 0;
+    ++line;
+    line += strspn(line, " \t");
+  }
+  // Strip visual name (VISUAL:, where VISUAL can't contain " or whitespace).
+  size_t visual_len = strcspn(line, "\" \t");
+  char *colon = strchr(line, ':');
+  if (colon != NULL && colon < line + visual_len) {
+    line = colon + 1;
+    line += strspn(line, " \t");
+  }
+  // Strip textual description ("description").
+  if (*line == '"') {
+    char *end = strchr(line + 1, '"');
+    if (end != NULL) {
+      line = end + 1;
+      line += strspn(line, " \t");
+    }
+  }
+  // What's remaining is the program name with its options.
+  size_t len = strlen(line);
+  while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) {
+    line[--len] = 0;
+  }
+  AddSaver(number, enabled, line);
+}
+
+static char *GetResource(XrmDatabase db, const char *name, const char *cls) {
+  char *type;
+  XrmValue value;
+  if (!XrmGetResource(db, name, cls, &type, &value) || value.addr == NULL) {
+    return NULL;
+  }
+  return StrDupOrDie(value.addr);
+}
+
+static int CompareStrings(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+//! Lists all programs in the XScreenSaver directory, like ls.
+static void ListAllPrograms(void) {
+  DIR *dir = opendir(xscreensaver_path);
+  if (dir == NULL) {
+    LogErrno("opendir %s", xscreensaver_path);
+    return;
+  }
+  char **names = NULL;
+  size_t num_names = 0, max_names = 0;
+  struct dirent *de;
+  while ((de = readdir(dir)) != NULL) {
+    if (de->d_name[0] == '.') {
+      continue;
+    }
+    if (num_names == max_names) {
+      max_names = max_names ? max_names * 2 : 256;
+      names = realloc(names, max_names * sizeof(*names));
+      if (names == NULL) {
+        Log("Out of memory");
+        exit(1);
+      }
+    }
+    names[num_names++] = StrDupOrDie(de->d_name);
+  }
+  closedir(dir);
+  qsort(names, num_names, sizeof(*names), CompareStrings);
+  for (size_t i = 0; i < num_names; ++i) {
+    char program[1024];
+    snprintf(program, sizeof(program), "%s -root", names[i]);
+    AddSaver((int)i, 1, program);
+    free(names[i]);
+  }
+  free(names);
+}
+
+/*! \brief Loads the saver list and settings, unless they are up to date.
+ */
+static void LoadSettings(void) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/.xscreensaver",
+           GetStringSetting("HOME", ""));
+  struct stat st;
+  long long mtime = stat(path, &st) == 0 ? (long long)st.st_mtime : -1;
+  if (mtime == loaded_mtime) {
+    return;
+  }
+  loaded_mtime = mtime;
+
+  for (size_t i = 0; i < num_savers; ++i) {
+    free(savers[i].command);
+  }
+  num_savers = 0;
+  free(mode);
+  mode = NULL;
+  free(selected_setting);
+  selected_setting = NULL;
+
+  XrmDatabase db = mtime == -1 ? NULL : XrmGetFileDatabase(path);
+  if (db == NULL) {
+    ListAllPrograms();
+    return;
+  }
+  char *programs = GetResource(db, "programs", "Programs");
+  if (programs != NULL) {
+    int number = 0;
+    // Note: unlike strtok_r, this must not skip empty lines, as they count.
+    for (char *line = programs; line != NULL; ++number) {
+      char *next = strchr(line, '\n');
+      if (next != NULL) {
+        *next++ = 0;
+      }
+      ParseProgram(number, line);
+      line = next;
+    }
+    free(programs);
+  }
+  mode = GetResource(db, "mode", "Mode");
+  selected_setting = GetResource(db, "selected", "Selected");
+  XrmDestroyDatabase(db);
+}
+
+static void ListSavers(int want_all) {
+  for (size_t i = 0; i < num_savers; ++i) {
+    if (want_all || savers[i].enabled) {
+      printf("%d\t%s\n", savers[i].number, savers[i].command);
+    }
+  }
+}
+
+/*! \brief Picks the saver to run.
+ *
+ * \return The saver, or NULL if none was found.
+ */
+static const struct Saver *SelectSaver(const char *current_mode,
+                                       long selected) {
+  if (current_mode != NULL && !strcmp(current_mode, "one")) {
+    for (size_t i = 0; i < num_savers; ++i) {
+      if (savers[i].number == selected) {
+        return &savers[i];
+      }
+    }
+    return NULL;
+  }
+  size_t count = 0;
+  for (size_t i = 0; i < num_savers; ++i) {
+    count += savers[i].enabled;
+  }
+  if (count == 0) {
+    return NULL;
+  }
+  size_t index = (size_t)selected % count;
+  for (size_t i = 0; i < num_savers; ++i) {
+    if (savers[i].enabled && index-- == 0) {
+      return &savers[i];
+    }
+  }
+  return NULL;
+}
+
+/*! \brief Executes a saver command line.
+ *
+ * Like XScreenSaver, this only uses a shell if the command line needs one.
+ */
+static void ExecSaver(const char *command) {
+  if (strpbrk(command, SHELL_CHARS) != NULL) {
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    LogErrno("execl /bin/sh");
+    return;
+  }
+  char *copy = StrDupOrDie(command);
+  char *argv[256];
+  size_t argc = 0;
+  char *saveptr = NULL;
+  for (char *arg = strtok_r(copy, " \t\n", &saveptr);
+       arg != NULL && argc < sizeof(argv) / sizeof(*argv) - 1;
+       arg = strtok_r(NULL, " \t\n", &saveptr)) {
+    argv[argc++] = arg;
+  }
+  argv[argc] = NULL;
+  execv(argv[0], argv);
+  LogErrno("execv %s", argv[0]);
+}
+
+/*! \brief Runs a saver until it exits.
+ *
+ * \return The exit status of the saver, or 0 if it was reset via SIGUSR1.
+ */
+static int RunSaver(const char *command) {
+  sigusr1_caught = 0;
+  pid_t pid = fork();
+  if (pid == -1) {
+    LogErrno("fork");
+    return 1;
+  }
+  if (pid == 0) {
+    signal(SIGUSR1, SIG_DFL);
+    ExecSaver(command);
+    _exit(127);
+  }
+  int status;
+  while (waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR) {
+      LogErrno("waitpid");
+      return 1;
+    }
+  }
+  if (sigusr1_caught) {
+    return 0;
+  }
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  if (WIFSIGNALED(status) && WTERMSIG(status) == SIGUSR1) {
+    return 0;
+  }
+  return 128 + WTERMSIG(status);
+}
+
+int main(int argc, char **argv) {
+  xscreensaver_path =
+      GetStringSetting("XSECURELOCK_XSCREENSAVER_PATH", XSCREENSAVER_PATH);
+  XrmInitialize();
+  LoadSettings();
+  srandom((unsigned int)time(NULL) ^ (unsigned int)getpid());
+
+  // Debug mode to list all savers.
+  if (argc > 1 && !strcmp(argv[1], "--list_savers")) {
+    ListSavers(0);
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "--list_all_savers")) {
+    ListSavers(1);
+    return 0;
+  }
+
+  // On SIGUSR1, we exit the saver and retry the selection.
+  struct sigaction sa;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = 0;
+  sa.sa_handler = HandleSIGUSR1;
+  if (sigaction(SIGUSR1, &sa, NULL) != 0) {
+    LogErrno("sigaction(SIGUSR1)");
+  }
+
+  char *current_mode = mode == NULL ? NULL : StrDupOrDie(mode);
+  long selected;
+  if (current_mode != NULL && !strcmp(current_mode, "one") &&
+      selected_setting != NULL) {
+    selected = atol(selected_setting);
+  } else if (current_mode != NULL && !strcmp(current_mode, "random")) {
+    // NOT random-same.
+    selected = random();
+  } else {
+    // We're using the parent process ID here, which may be a saver_multiplex
+    // instance. This ensures that multiple instances of this always spawn the
+    // same saver on each screen.
+    selected = getppid();
+  }
+
+  for (;;) {
+    LoadSettings();
+    const struct Saver *saver = SelectSaver(current_mode, selected);
+    if (saver == NULL) {
+      Log("No saver selected. Giving up");
+      execl("./saver_blank", "./saver_blank", (char *)NULL);
+      LogErrno("execl ./saver_blank");
+      return 1;
+    }
+    char *command = StrDupOrDie(saver->command);
+    int status = RunSaver(command);
+    if (status == 0) {
+      // Immediately try the next saver.
+      if (current_mode == NULL || strcmp(current_mode, "one")) {
+        ++selected;
+      }
+    } else {
+      // Saver failed entirely. Just give up.
+      Log("Screen saver failed with status %d: %s", status, command);
+      sleep(2);  // Anti-spam delay.
+      if (current_mode != NULL && !strcmp(current_mode, "random")) {
+        free(command);
+        return status;
+      }
+      // As a fallback, when the saver failed, try random.
+      free(current_mode);
+      current_mode = StrDupOrDie("random");
+      selected = random();
+    }
+    free(command);
+  }
+}
@@ -24,127 +24,90 @@ limitations under the License.
  *
  * Sample usage:
  *   until_nonidle dim-screen || xsecurelock
+ *
+ * Alternatively, the locker can be given after a "--" argument. It is then
+ * started right away in a prepared but not yet locked state, and the lock is
+ * committed once the dimming tool is done, or aborted on activity:
+ *   until_nonidle dim-screen -- xsecurelock
+ * Should the pre-staged locker die before locking, the locker is started again
+ * the usual way once the dimming tool is done.
  */
 
-#include <X11/X.h>     // for Window
-#include <X11/Xlib.h>  // for Display, XOpenDisplay, Default...
-#include <signal.h>    // for sigaction, raise, sigemptyset
-#include <stdint.h>    // for uint64_t
-#include <stdlib.h>    // for NULL, size_t, EXIT_FAILURE
-#include <string.h>    // for memcpy, NULL, strcmp, strcspn
-#include <sys/time.h>  // for gettimeofday, timeval
-#include <time.h>      // for nanosleep, timespec
-#include <unistd.h>    // for _exit, execvp, fork, setsid
-
-#ifdef HAVE_XSCREENSAVER_EXT
-#include <X11/extensions/scrnsaver.h>  // for XScreenSaverAllocInfo, XScreen...
-#endif
-
-#ifdef HAVE_XSYNC_EXT
-#include <X11/extensions/sync.h>       // for XSyncSystemCounter, XSyncListS...
-#include <X11/extensions/syncconst.h>  // for XSyncValue
-#endif
-
-#include "../env_settings.h"  // for GetIntSetting, GetStringSetting
+#include <X11/X.h>       // for Window
+#include <X11/Xlib.h>    // for Display, XOpenDisplay, Default...
+#include <signal.h>      // for sigaction, raise, sigemptyset
+#include <stdint.h>      // for uint64_t
+#include <stdlib.h>      // for NULL, EXIT_FAILURE
+#include <string.h>      // for memset, strcmp
+#include <sys/select.h>  // for pselect, FD_SET, FD_ZERO, fd_set
+#include <sys/time.h>    // for gettimeofday, timeval
+#include <time.h>        // for timespec
+#include <unistd.h>      // for _exit, close, execvp
+
+#include "../env_settings.h"  // for GetIntSetting
 #include "../logging.h"       // for Log, LogErrno
+#include "../util.h"          // for MillisecondsSince
 #include "../wait_pgrp.h"     // for KillPgrp, WaitPgrp
+#include "idle_timers.h"      // for GetIdleTime, InitIdleTimers, CreateId...
+#include "prestage.h"         // for CommitPrestagedLocker, StartPrestaged...
 
-#ifdef HAVE_XSCREENSAVER_EXT
-int have_xscreensaver_ext;
-XScreenSaverInfo *saver_info;
-#endif
-
-#ifdef HAVE_XSYNC_EXT
-int have_xsync_ext;
-int num_xsync_counters;
-XSyncSystemCounter *xsync_counters;
-#endif
+//! How often to poll idle timers that we cannot get alarms for, in ms.
+#define IDLE_POLL_INTERVAL_MS 10
 
 pid_t childpid = 0;
+pid_t lockerpid = 0;
 
 static void HandleSIGTERM(int signo) {
   if (childpid != 0) {
     KillPgrp(childpid, signo);  // Dirty, but quick.
   }
+  // No need to kill the locker: our end of the socket closing aborts it if it
+  // did not lock yet, and once locked it must keep running.
   raise(signo);
 }
 
-uint64_t GetIdleTimeForSingleTimer(Display *display, Window w,
-                                   const char *timer) {
-  if (*timer == 0) {
-#ifdef HAVE_XSCREENSAVER_EXT
-    if (have_xscreensaver_ext) {
-      XScreenSaverQueryInfo(display, w, saver_info);
-      return saver_info->idle;
-    }
-#endif
-  } else {
-#ifdef HAVE_XSYNC_EXT
-    if (have_xsync_ext) {
-      for (int i = 0; i < num_xsync_counters; ++i) {
-        if (!strcmp(timer,
-                    xsync_counters[i].name)) {  // I know this is inefficient.
-          XSyncValue value;
-          XSyncQueryCounter(display, xsync_counters[i].counter, &value);
-          return (((uint64_t)XSyncValueHigh32(value)) << 32) |
-                 (uint64_t)XSyncValueLow32(value);
-        }
-      }
+/*! \brief Handles all pending X11 events.
+ *
+ * \return 1 if any of our idle alarms fired.
+ */
+int HandleEvents(Display *display) {
+  int got_alarm = 0;
+  while (XPending(display)) {
+    XEvent ev;
+    XNextEvent(display, &ev);
+    if (IsIdleAlarmEvent(&ev)) {
+      got_alarm = 1;
     }
-#endif
   }
-  Log("Timer \"%s\" not supported", timer);
-  (void)display;
-  (void)w;
-  return (uint64_t)-1;
+  return got_alarm;
 }
 
-uint64_t GetIdleTime(Display *display, Window w, const char *timers) {
-  uint64_t min_idle_time = (uint64_t)-1;
-  for (;;) {
-    size_t len = strcspn(timers, ",");
-    if (timers[len] == 0) {  // End of string.
-      uint64_t this_idle_time = GetIdleTimeForSingleTimer(display, w, timers);
-      if (this_idle_time < min_idle_time) {
-        min_idle_time = this_idle_time;
-      }
-      return min_idle_time;
-    }
-    char this_timer[64];
-    if (len < sizeof(this_timer)) {
-      memcpy(this_timer, timers, len);
-      this_timer[len] = 0;
-      uint64_t this_idle_time =
-          GetIdleTimeForSingleTimer(display, w, this_timer);
-      if (this_idle_time < min_idle_time) {
-        min_idle_time = this_idle_time;
-      }
-    } else {
-      Log("Too long timer name - skipping: %s", timers);
+int main(int argc, char **argv) {
+  // Split off the locker command, if any.
+  char **locker_argv = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--")) {
+      argv[i] = NULL;
+      locker_argv = argv + i + 1;
+      argc = i;
+      break;
     }
-    timers += len + 1;
   }
-}
 
-int main(int argc, char **argv) {
-  if (argc <= 1) {
-    Log("Usage: %s program args... - runs the given program until non-idle",
+  if (argc <= 1 || (locker_argv != NULL && *locker_argv == NULL)) {
+    Log("Usage: %s program args... [-- locker args...] - runs the given "
+        "program until non-idle",
         argv[0]);
     Log("Meant to be used with dimming tools, like: %s dimmer || xsecurelock",
         argv[0]);
     Log("Returns 0 when no longer idle, and 1 when still idle");
+    Log("If a locker is given, it is pre-staged while dimming; then returns "
+        "the locker's exit status when it locked, and 0 when no longer idle");
     return 1;
   }
 
   int dim_time_ms = GetIntSetting("XSECURELOCK_DIM_TIME_MS", 2000);
   int wait_time_ms = GetIntSetting("XSECURELOCK_WAIT_TIME_MS", 5000);
-  const char *timers = GetStringSetting("XSECURELOCK_IDLE_TIMERS",
-#ifdef HAVE_XSCREENSAVER_EXT
-                                        ""
-#else
-                                        "IDLETIME"
-#endif
-  );
 
   Display *display = XOpenDisplay(NULL);
   if (display == NULL) {
@@ -153,32 +116,19 @@ int main(int argc, char **argv) {
   }
   Window root_window = DefaultRootWindow(display);
 
-  // Initialize the extensions.
-#ifdef HAVE_XSCREENSAVER_EXT
-  have_xscreensaver_ext = 0;
-  int scrnsaver_event_base, scrnsaver_error_base;
-  if (XScreenSaverQueryExtension(display, &scrnsaver_event_base,
-                                 &scrnsaver_error_base)) {
-    have_xscreensaver_ext = 1;
-    saver_info = XScreenSaverAllocInfo();
-  }
-#endif
-#ifdef HAVE_XSYNC_EXT
-  have_xsync_ext = 0;
-  int sync_event_base, sync_error_base;
-  if (XSyncQueryExtension(display, &sync_event_base, &sync_error_base)) {
-    have_xsync_ext = 1;
-    xsync_counters = XSyncListSystemCounters(display, &num_xsync_counters);
-  }
-#endif
+  // Look up the idle timers once.
+  InitIdleTimers(display);
 
   // Capture the initial idle time.
-  uint64_t prev_idle = GetIdleTime(display, root_window, timers);
+  uint64_t prev_idle = GetIdleTime(display, root_window);
   if (prev_idle == (uint64_t)-1) {
     Log("Could not initialize idle timers. Bailing out.");
     return 1;
   }
 
+  // Get notified when the idle timers are reset, so we needn't poll.
+  int need_polling = !CreateIdleAlarms(display);
+
   // Start the subprocess.
   childpid = ForkWithoutSigHandlers();
   if (childpid == -1) {
@@ -204,31 +154,110 @@ int main(int argc, char **argv) {
 
   InitWaitPgrp();
 
+  // Get the locker ready while dimming, if any.
+  int prestage_fd = -1;
+  if (locker_argv != NULL) {
+    prestage_fd = StartPrestagedLocker(locker_argv, &lockerpid);
+  }
+  int locked = 0;
+
+  sigset_t sigchld_set, orig_set;
+  sigemptyset(&sigchld_set);
+  sigaddset(&sigchld_set, SIGCHLD);
+
+  int x11_fd = ConnectionNumber(display);
   struct timeval start_time;
   gettimeofday(&start_time, NULL);
   int still_idle = 1;
+  // Activity may have happened before the alarms were set up.
+  int need_check = 1;
   while (childpid != 0) {
-    nanosleep(&(const struct timespec){0, 10000000L}, NULL);  // 10ms.
+    if (!need_check) {
+      // Block SIGCHLD so the child exiting after WaitPgrp interrupts pselect.
+      sigprocmask(SIG_BLOCK, &sigchld_set, &orig_set);
+      int status;
+      if (lockerpid != 0 && WaitPgrp("locker", &lockerpid, 0, 0, &status)) {
+        Log("Locker exited before the lock was committed");
+        close(prestage_fd);
+        prestage_fd = -1;
+      }
+      if (!WaitPgrp("idle", &childpid, 0, 0, &status) && !XPending(display)) {
+        // Sleep until user activity, the deadline or the next poll.
+        long timeout_ms = dim_time_ms + wait_time_ms + 1 -
+                          (long)MillisecondsSince(&start_time);
+        if (need_polling && timeout_ms > IDLE_POLL_INTERVAL_MS) {
+          timeout_ms = IDLE_POLL_INTERVAL_MS;
+        }
+        if (timeout_ms > 0) {
+          fd_set in_fds;
+          memset(&in_fds, 0, sizeof(in_fds));  // For clang-analyzer.
+          FD_ZERO(&in_fds);
+          FD_SET(x11_fd, &in_fds);
+          int max_fd = x11_fd;
+          if (prestage_fd != -1) {
+            // Readable when the locker exits.
+            FD_SET(prestage_fd, &in_fds);
+            if (prestage_fd > max_fd) {
+              max_fd = prestage_fd;
+            }
+          }
+          struct timespec timeout;
+          timeout.tv_sec = timeout_ms / 1000;
+          timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+          pselect(max_fd + 1, &in_fds, NULL, NULL, &timeout, &orig_set);
+        }
+      }
+      sigprocmask(SIG_SETMASK, &orig_set, NULL);
+      if (childpid == 0) {
+        break;
+      }
+    }
 
-    uint64_t cur_idle = GetIdleTime(display, root_window, timers);
-    still_idle = cur_idle >= prev_idle;
-    prev_idle = cur_idle;
+    if (HandleEvents(display) || need_polling || need_check) {
+      uint64_t cur_idle = GetIdleTime(display, root_window);
+      still_idle = cur_idle >= prev_idle;
+      prev_idle = cur_idle;
+      need_check = 0;
+    }
 
     // Also exit when both dim and wait time expire. This allows using
     // xss-lock's dim-screen.sh without changes.
-    struct timeval current_time;
-    gettimeofday(&current_time, NULL);
-    int active_ms = (current_time.tv_sec - start_time.tv_sec) * 1000 +
-                    (current_time.tv_usec - start_time.tv_usec) / 1000;
+    int active_ms = (int)MillisecondsSince(&start_time);
     int should_be_running =
         still_idle && (active_ms <= dim_time_ms + wait_time_ms);
 
     if (!should_be_running) {
+      if (still_idle && prestage_fd != -1) {
+        // Keep dimming until the locker covers the screen.
+        locked = CommitPrestagedLocker(prestage_fd);
+      }
       KillPgrp(childpid, SIGTERM);
+      int status;
+      WaitPgrp("idle", &childpid, 1, 1, &status);
+    }
+  }
+
+  if (lockerpid != 0) {
+    if (!locked && still_idle && prestage_fd != -1) {
+      // The dimming tool exited by itself - time to lock.
+      locked = CommitPrestagedLocker(prestage_fd);
+    }
+    // If not committed, this makes the locker abort.
+    if (prestage_fd != -1) {
+      close(prestage_fd);
     }
     int status;
-    WaitPgrp("idle", &childpid, !should_be_running, !should_be_running,
-             &status);
+    WaitPgrp("locker", &lockerpid, 1, 0, &status);
+    if (locked) {
+      return status >= 0 ? status : 1;
+    }
+  }
+
+  if (locker_argv != NULL && still_idle) {
+    // The pre-staged locker died or could not be started. Still lock.
+    Log("Pre-staged locker did not lock - starting it again");
+    execvp(locker_argv[0], locker_argv);
+    LogErrno("execvp");
   }
 
   // This is the point where we can exit.
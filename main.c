@@ -28,6 +28,7 @@ limitations under the License.
 #include <X11/Xutil.h>       // for XLookupString
 #include <X11/cursorfont.h>  // for XC_arrow
 #include <X11/keysym.h>      // for XK_BackSpace, XK_Tab, XK_o
+#include <errno.h>           // for EINTR, errno
 #include <fcntl.h>           // for fcntl, FD_CLOEXEC, F_GETFD
 #include <locale.h>          // for NULL, setlocale, LC_CTYPE
 #include <signal.h>          // for sigaction, raise, sa_handler
@@ -37,7 +38,7 @@ limitations under the License.
 #include <sys/select.h>      // for select, timeval, fd_set, FD_SET
 #include <sys/time.h>        // for gettimeofday
 #include <time.h>            // for nanosleep, timespec
-#include <unistd.h>          // for _exit, chdir, close, execvp
+#include <unistd.h>          // for _exit, chdir, close, execvp, read
 
 #ifdef HAVE_DPMS_EXT
 #include <X11/Xmd.h>  // for BOOL, CARD16
@@ -56,6 +57,9 @@ limitations under the License.
 #ifdef HAVE_XF86MISC_EXT
 #include <X11/extensions/xf86misc.h>  // for XF86MiscSetGrabKeysState
 #endif
+#ifdef HAVE_XPRESENT_EXT
+#include <X11/extensions/Xpresent.h>  // for XPresentNotifyMSC, XPresentSel...
+#endif
 #ifdef HAVE_XFIXES_EXT
 #include <X11/extensions/Xfixes.h>      // for XFixesQueryExtension, XFixesS...
 #include <X11/extensions/shapeconst.h>  // for ShapeBounding
@@ -63,14 +67,20 @@ limitations under the License.
 
 #include "auth_child.h"     // for KillAuthChildSigHandler, Want...
 #include "env_settings.h"   // for GetIntSetting, GetExecutableP...
+#include "helpers/monitors.h"  // for PublishMonitors, IsMonitorChang...
+#include "helpers/multiplex.h"  // for InitMultiplex, WatchMultiplexedS...
+#include "helpers/prestage.h"  // for WaitForPrestageCommit, ConfirmPre...
 #include "logging.h"        // for Log, LogErrno
 #include "mlock_page.h"     // for MLOCK_PAGE
 #include "saver_child.h"    // for WatchSaverChild, KillAllSaver...
+#include "session_log.h"    // for CountSessionEvent, WriteSessionLog
+#include "supervisor.h"     // for Supervise
 #include "unmap_all.h"      // for ClearUnmapAllWindowsState
-#include "util.h"           // for explicit_bzero
+#include "util.h"           // for explicit_bzero, MillisecondsSince
 #include "version.h"        // for git_version
 #include "wait_pgrp.h"      // for WaitPgrp
 #include "wm_properties.h"  // for SetWMProperties
+#include "xserver_watchdog.h"  // for MaybePingXServer, InitXServerWat...
 
 /*! \brief How often (in times per second) to watch child processes.
  *
@@ -86,6 +96,15 @@ limitations under the License.
  */
 #undef ALWAYS_REINSTATE_GRABS
 
+//! The serial of the Present request confirming the lock.
+#define LOCK_PRESENT_SERIAL 1
+
+/*! \brief How long to wait for Present to confirm the lock.
+ *
+ * After this, confirming the lock falls back to VisibilityNotify.
+ */
+#define LOCK_PRESENT_TIMEOUT_MS 1000
+
 /*! \brief Try to bring the grab window to foreground in regular intervals.
  *
  * Some desktop environments have transparent OverrideRedirect notifications.
@@ -130,6 +149,9 @@ struct {
 const char *auth_executable;
 //! The name of the saver child to execute, relative to HELPER_PATH.
 const char *saver_executable;
+//! If set, we run saver_executable on each monitor ourselves, instead of
+//! running saver_multiplex to do that.
+const char *multiplexed_saver_executable = NULL;
 //! The command to run once screen locking is complete.
 char *const *notify_command = NULL;
 #ifdef HAVE_XCOMPOSITE_EXT
@@ -144,6 +166,14 @@ int have_switch_user_command = 0;
 int force_grab = 0;
 //! If set, print window info about any "conflicting" windows to stderr.
 int debug_window_info = 0;
+//! If set, log how long unlocking takes.
+int debug_timing = 0;
+#ifdef HAVE_XPRESENT_EXT
+//! If set, confirm the lock only once a frame showing it has been presented.
+int confirm_lock_present = 0;
+//! The major opcode of the Present extension, or 0 if not in use.
+int present_opcode = 0;
+#endif
 //! If nonnegative, the time in seconds till we blank the screen explicitly.
 int blank_timeout = -1;
 //! The DPMS state to switch the screen to when blanking.
@@ -201,6 +231,7 @@ void MaybeBlankScreen(Display *display) {
   }
   // Blank timer expired - blank the screen.
   blanked = 1;
+  CountSessionEvent(SESSION_BLANK);
   XForceScreenSaver(display, ScreenSaverActive);
   if (!strcmp(blank_dpms_state, "on")) {
     // Just X11 blanking.
@@ -249,6 +280,9 @@ void ScreenNoLongerBlanked(Display *display) {
     XFlush(display);
   }
 #endif
+  if (blanked) {
+    CountSessionEvent(SESSION_UNBLANK);
+  }
   blanked = 0;
 }
 
@@ -272,6 +306,19 @@ static void HandleSIGUSR2(int unused_signo) {
   signal_wakeup = 1;
 }
 
+/*! \brief Starts or stops the global saver, or the per-monitor savers.
+ *
+ * \param saver_win The window the savers draw in.
+ * \param should_be_running Whether the savers should be running.
+ */
+void WatchSavers(Display *dpy, Window saver_win, int should_be_running) {
+  if (multiplexed_saver_executable != NULL) {
+    WatchMultiplexedSavers(should_be_running);
+  } else {
+    WatchSaverChild(dpy, saver_win, 0, saver_executable, should_be_running);
+  }
+}
+
 enum WatchChildrenState {
   //! Request saver child.
   WATCH_CHILDREN_NORMAL,
@@ -312,8 +359,10 @@ int WatchChildren(Display *dpy, Window auth_win, Window saver_win,
     if (WatchAuthChild(auth_win, auth_executable,
                        state == WATCH_CHILDREN_FORCE_AUTH, stdinbuf,
                        &auth_running)) {
-      // Auth performed successfully. Terminate the other children.
-      WatchSaverChild(dpy, saver_win, 0, saver_executable, 0);
+      // Auth performed successfully. Tell the other children to terminate,
+      // but do not wait for them; the screen gets released first, and they
+      // get reaped after that.
+      KillAllSaverChildrenSigHandler(SIGTERM);
       // Now terminate the screen lock.
       return 1;
     }
@@ -329,8 +378,7 @@ int WatchChildren(Display *dpy, Window auth_win, Window saver_win,
   }
 
   // Show the screen saver.
-  WatchSaverChild(dpy, saver_win, 0, saver_executable,
-                  state != WATCH_CHILDREN_SAVER_DISABLED);
+  WatchSavers(dpy, saver_win, state != WATCH_CHILDREN_SAVER_DISABLED);
 
   if (auth_running) {
     // While auth is running, we never blank.
@@ -438,6 +486,10 @@ void LoadDefaults() {
       *GetStringSetting("XSECURELOCK_SWITCH_USER_COMMAND", "");
   force_grab = GetIntSetting("XSECURELOCK_FORCE_GRAB", 0);
   debug_window_info = GetIntSetting("XSECURELOCK_DEBUG_WINDOW_INFO", 0);
+  debug_timing = GetIntSetting("XSECURELOCK_DEBUG_TIMING", 0);
+#ifdef HAVE_XPRESENT_EXT
+  confirm_lock_present = GetIntSetting("XSECURELOCK_CONFIRM_LOCK_PRESENT", 0);
+#endif
   blank_timeout = GetIntSetting("XSECURELOCK_BLANK_TIMEOUT", 600);
   blank_dpms_state = GetStringSetting("XSECURELOCK_BLANK_DPMS_STATE", "off");
   saver_reset_on_auth_close =
@@ -515,6 +567,19 @@ int CheckSettings() {
   return 1;
 }
 
+/*! \brief Decides whether to run the per-monitor savers ourselves.
+ *
+ * saver_multiplex would only open another display connection and query the
+ * monitors again, so we do its job ourselves. Any other global saver, or
+ * saver_multiplex given by absolute path, is run as is.
+ */
+void SetUpSaverMultiplexing() {
+  if (strcmp(saver_executable, "saver_multiplex") == 0) {
+    multiplexed_saver_executable =
+        GetExecutablePathSetting("XSECURELOCK_SAVER", SAVER_EXECUTABLE, 0);
+  }
+}
+
 /*! \brief Print some debug info about a window.
  *
  * Only enabled if debug_window_info is set.
@@ -590,6 +655,7 @@ void MaybeRaiseWindow(Display *display, Window w, int silent, int force) {
   XFree(siblings);
   if (need_raise) {
     XRaiseWindow(display, w);
+    CountSessionEvent(SESSION_RAISE);
   }
 }
 
@@ -680,14 +746,20 @@ int AcquireGrabs(Display *display, Window root_window, Window *ignored_windows,
  * This enables xss-lock to delay going to sleep until the screen is actually
  * locked - useful to prevent information leaks after wakeup.
  *
+ * Also confirms the lock to until_nonidle when it pre-staged us.
+ *
  * \param fd The file descriptor of the X11 connection that we shouldn't close.
+ * \param prestage_fd The socket to until_nonidle, or -1.
  */
-void NotifyOfLock(int xss_sleep_lock_fd) {
+void NotifyOfLock(int xss_sleep_lock_fd, int prestage_fd) {
   if (xss_sleep_lock_fd != -1) {
     if (close(xss_sleep_lock_fd) != 0) {
       LogErrno("close(XSS_SLEEP_LOCK_FD)");
     }
   }
+  if (prestage_fd != -1) {
+    ConfirmPrestagedLock(prestage_fd);
+  }
   if (notify_command != NULL && *notify_command != NULL) {
     pid_t pid = ForkWithoutSigHandlers();
     if (pid == -1) {
@@ -704,6 +776,42 @@ void NotifyOfLock(int xss_sleep_lock_fd) {
   }
 }
 
+#ifdef HAVE_XPRESENT_EXT
+/*! \brief Checks whether the event says the frame with the lock was shown.
+ */
+int IsLockPresentedEvent(Display *display, XEvent *ev) {
+  if (present_opcode == 0 || ev->type != GenericEvent ||
+      ev->xcookie.extension != present_opcode ||
+      !XGetEventData(display, &ev->xcookie)) {
+    return 0;
+  }
+  int found = 0;
+  if (ev->xcookie.evtype == PresentCompleteNotify) {
+    XPresentCompleteNotifyEvent *complete = ev->xcookie.data;
+    found = complete->serial_number == LOCK_PRESENT_SERIAL;
+  }
+  XFreeEventData(display, &ev->xcookie);
+  return found;
+}
+#endif
+
+/*! \brief Makes sure that child processes do not inherit a file descriptor.
+ *
+ * Failures are logged but otherwise ignored.
+ */
+void SetCloseOnExec(int fd, const char *name) {
+  int flags = fcntl(fd, F_GETFD);
+  if (flags == -1) {
+    LogErrno("fcntl(%s, F_GETFD)", name);
+  } else {
+    flags |= FD_CLOEXEC;
+    int status = fcntl(fd, F_SETFD, flags);
+    if (status == -1) {
+      LogErrno("fcntl(%s, F_SETFD, %#x)", name, flags);
+    }
+  }
+}
+
 int CheckLockingEffectiveness() {
   // When this variable is set, all checks in here are still evaluated but we
   // try locking anyway.
@@ -747,28 +855,72 @@ int CheckLockingEffectiveness() {
   return 1;
 }
 
+#ifdef HAVE_XCOMPOSITE_EXT
+/*! \brief Gets the Composite Overlay Window, to put our windows into.
+ *
+ * This maps it, so it covers everything from now on.
+ */
+static Window GetCompositeOverlayWindow(Display *display, Window root_window) {
+  Window composite_window = XCompositeGetOverlayWindow(display, root_window);
+  // Some compositers may unmap or shape the overlay window - undo that, just
+  // in case.
+  XMapRaised(display, composite_window);
+#ifdef HAVE_XFIXES_EXT
+  int xfixes_event_base, xfixes_error_base;
+  if (XFixesQueryExtension(display, &xfixes_event_base, &xfixes_error_base)) {
+    XFixesSetWindowShapeRegion(display, composite_window, ShapeBounding,  //
+                               0, 0, 0);
+  }
+#endif
+  // Let's get notified if we lose visibility, so we can self-raise.
+  XSelectInput(display, composite_window,
+               StructureNotifyMask | VisibilityChangeMask);
+  // Bypass compositing, just in case a compositor were to try compositing it
+  // (xcompmgr does, but doesn't know this property anyway).
+  Atom dont_composite_atom =
+      XInternAtom(display, "_NET_WM_BYPASS_COMPOSITOR", False);
+  long dont_composite = 1;
+  XChangeProperty(display, composite_window, dont_composite_atom, XA_CARDINAL,
+                  32, PropModeReplace, (const unsigned char *)&dont_composite,
+                  1);
+  return composite_window;
+}
+#endif
+
 /*! \brief The main program.
  *
  * Usage: see Usage().
  */
 int main(int argc, char **argv) {
   setlocale(LC_CTYPE, "");
+  InitSessionLog();
+
+  // When we started unlocking, for debug_timing.
+  struct timeval unlock_start;
 
   int xss_sleep_lock_fd = GetIntSetting("XSS_SLEEP_LOCK_FD", -1);
   if (xss_sleep_lock_fd != -1) {
     // Children processes should not inherit the sleep lock
     // Failures are not critical, systemd will ignore the lock
     // when InhibitDelayMaxSec is reached
-    int flags = fcntl(xss_sleep_lock_fd, F_GETFD);
-    if (flags == -1) {
-      LogErrno("fcntl(XSS_SLEEP_LOCK_FD, F_GETFD)");
-    } else {
-      flags |= FD_CLOEXEC;
-      int status = fcntl(xss_sleep_lock_fd, F_SETFD, flags);
-      if (status == -1) {
-        LogErrno("fcntl(XSS_SLEEP_LOCK_FD, F_SETFD, %#x)", flags);
-      }
-    }
+    SetCloseOnExec(xss_sleep_lock_fd, "XSS_SLEEP_LOCK_FD");
+  }
+
+  // When pre-staged by until_nonidle, we prepare everything while the screen
+  // is dimming, but only lock once told so via this socket.
+  int prestage_fd = GetIntSetting("XSECURELOCK_PRESTAGE_FD", -1);
+  unsetenv("XSECURELOCK_PRESTAGE_FD");
+  if (prestage_fd != -1) {
+    SetCloseOnExec(prestage_fd, "XSECURELOCK_PRESTAGE_FD");
+  }
+  // Spare lockers of the supervisor must not run savers next to the active
+  // locker's ones until they get committed.
+  int prestage_savers = !GetIntSetting("XSECURELOCK_SUPERVISOR_SPARE", 0);
+  unsetenv("XSECURELOCK_SUPERVISOR_SPARE");
+
+  // When supervising, we merely keep relocking until the user authenticates.
+  if (GetIntSetting("XSECURELOCK_SUPERVISE", 0)) {
+    return Supervise(argv, xss_sleep_lock_fd, prestage_fd);
   }
 
   // Switch to the root directory to not hold on to any directory descriptors
@@ -792,6 +944,7 @@ int main(int argc, char **argv) {
     Usage(argv[0]);
     return 1;
   }
+  SetUpSaverMultiplexing();
 
   // Check if we are in a lockable session.
   if (!CheckLockingEffectiveness()) {
@@ -875,19 +1028,14 @@ int main(int argc, char **argv) {
     have_xcomposite_ext = 0;
   }
   Window composite_window = None, obscurer_window = None;
-  if (have_xcomposite_ext) {
-    composite_window = XCompositeGetOverlayWindow(display, root_window);
-    // Some compositers may unmap or shape the overlay window - undo that, just
-    // in case.
-    XMapRaised(display, composite_window);
-#ifdef HAVE_XFIXES_EXT
-    int xfixes_event_base, xfixes_error_base;
-    if (XFixesQueryExtension(display, &xfixes_event_base, &xfixes_error_base)) {
-      XFixesSetWindowShapeRegion(display, composite_window, ShapeBounding,  //
-                                 0, 0, 0);
-    }
-#endif
+  // Fetching the overlay window maps it, and without a compositor it then
+  // covers the screen, dimmer included. So while pre-staged, our windows wait
+  // under the root, and only move into it once committed.
+  if (have_xcomposite_ext && prestage_fd == -1) {
+    composite_window = GetCompositeOverlayWindow(display, root_window);
     parent_window = composite_window;
+  }
+  if (have_xcomposite_ext) {
 
     if (composite_obscurer) {
       // Also create an "obscurer window" that we don't actually use but that
@@ -942,12 +1090,18 @@ int main(int argc, char **argv) {
   SetWMProperties(display, auth_window, "xsecurelock", "auth", argc, argv);
   my_windows[n_my_windows++] = auth_window;
 
+  // Publish the monitor configuration on the windows our helpers draw on, so
+  // they need not query XRandR themselves.
+  Window monitor_windows[3] = {background_window, saver_window, auth_window};
+  SelectMonitorChangeEvents(display, background_window);
+  PublishMonitors(display, monitor_windows, 3);
+  if (multiplexed_saver_executable != NULL) {
+    InitMultiplex(display, saver_window, multiplexed_saver_executable, argc,
+                  argv);
+  }
+
 // Let's get notified if we lose visibility, so we can self-raise.
 #ifdef HAVE_XCOMPOSITE_EXT
-  if (composite_window != None) {
-    XSelectInput(display, composite_window,
-                 StructureNotifyMask | VisibilityChangeMask);
-  }
   if (obscurer_window != None) {
     XSelectInput(display, obscurer_window,
                  StructureNotifyMask | VisibilityChangeMask);
@@ -980,19 +1134,9 @@ int main(int argc, char **argv) {
   XChangeProperty(display, background_window, dont_composite_atom, XA_CARDINAL,
                   32, PropModeReplace, (const unsigned char *)&dont_composite,
                   1);
-#ifdef HAVE_XCOMPOSITE_EXT
-  if (composite_window != None) {
-    // Also set this property on the Composite Overlay Window, just in case a
-    // compositor were to try compositing it (xcompmgr does, but doesn't know
-    // this property anyway).
-    XChangeProperty(display, composite_window, dont_composite_atom, XA_CARDINAL,
-                    32, PropModeReplace, (const unsigned char *)&dont_composite,
-                    1);
-  }
 // Note: NOT setting this on the obscurer window, as this is a fallback and
 // actually should be composited to make sure the compositor never draws
 // anything "interesting".
-#endif
 
   // Initialize XInput so we can get multibyte key events.
   XIM xim = XOpenIM(display, NULL, NULL, NULL);
@@ -1045,11 +1189,57 @@ int main(int argc, char **argv) {
   }
 #endif
 
+  if (MLOCK_PAGE(&priv, sizeof(priv)) < 0) {
+    LogErrno("mlock");
+    return EXIT_FAILURE;
+  }
+
+  struct sigaction sa;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = 0;
+  sa.sa_handler = SIG_IGN;  // Don't die if auth child closes stdin.
+  if (sigaction(SIGPIPE, &sa, NULL) != 0) {
+    LogErrno("sigaction(SIGPIPE)");
+  }
+  sa.sa_handler = HandleSIGUSR2; // For remote wakeups by system events.
+  if (sigaction(SIGUSR2, &sa, NULL) != 0) {
+    LogErrno("sigaction(SIGUSR2)");
+  }
+  sa.sa_flags = SA_RESETHAND;     // It re-raises to suicide.
+  sa.sa_handler = HandleSIGTERM;  // To kill children.
+  if (sigaction(SIGTERM, &sa, NULL) != 0) {
+    LogErrno("sigaction(SIGTERM)");
+  }
+
+  InitWaitPgrp();
+
+  Window previous_focused_window = None;
+  int previous_revert_focus_to = RevertToNone;
+
+  if (prestage_fd != -1) {
+    XFlush(display);
+    if (prestage_savers) {
+      // Get the saver going in our still unmapped window, so it is all set up
+      // by the time we lock.
+      WatchSavers(display, saver_window, 1);
+    }
+    if (!WaitForPrestageCommit(prestage_fd)) {
+      // User activity during dimming.
+      WatchSavers(display, saver_window, 0);
+      close(prestage_fd);
+      goto done;
+    }
+#ifdef HAVE_XCOMPOSITE_EXT
+    if (have_xcomposite_ext) {
+      composite_window = GetCompositeOverlayWindow(display, root_window);
+      XReparentWindow(display, background_window, composite_window, 0, 0);
+    }
+#endif
+  }
+
   // Acquire all grabs we need. Retry in case the window manager is still
   // holding some grabs while starting XSecureLock.
   int last_normal_attempt = force_grab ? 1 : 0;
-  Window previous_focused_window = None;
-  int previous_revert_focus_to = RevertToNone;
   int retries = 10;
   for (; retries >= 0; --retries) {
     if (AcquireGrabs(display, root_window, my_windows, n_my_windows,
@@ -1074,33 +1264,12 @@ int main(int argc, char **argv) {
   }
   if (retries < 0) {
     Log("Failed to grab. Giving up.");
+    // Pre-staged lockers already started their savers.
+    WatchSavers(display, saver_window, 0);
+    ReapAllSaverChildren();
     return EXIT_FAILURE;
   }
 
-  if (MLOCK_PAGE(&priv, sizeof(priv)) < 0) {
-    LogErrno("mlock");
-    return EXIT_FAILURE;
-  }
-
-  struct sigaction sa;
-  sigemptyset(&sa.sa_mask);
-  sa.sa_flags = 0;
-  sa.sa_handler = SIG_IGN;  // Don't die if auth child closes stdin.
-  if (sigaction(SIGPIPE, &sa, NULL) != 0) {
-    LogErrno("sigaction(SIGPIPE)");
-  }
-  sa.sa_handler = HandleSIGUSR2; // For remote wakeups by system events.
-  if (sigaction(SIGUSR2, &sa, NULL) != 0) {
-    LogErrno("sigaction(SIGUSR2)");
-  }
-  sa.sa_flags = SA_RESETHAND;     // It re-raises to suicide.
-  sa.sa_handler = HandleSIGTERM;  // To kill children.
-  if (sigaction(SIGTERM, &sa, NULL) != 0) {
-    LogErrno("sigaction(SIGTERM)");
-  }
-
-  InitWaitPgrp();
-
   // Need to flush the display so savers sure can access the window.
   XFlush(display);
 
@@ -1125,11 +1294,28 @@ int main(int argc, char **argv) {
     goto done;
   }
 
-  // Wait for children to initialize.
-  struct timespec sleep_ts;
-  sleep_ts.tv_sec = saver_delay_ms / 1000;
-  sleep_ts.tv_nsec = (saver_delay_ms % 1000) * 1000000L;
-  nanosleep(&sleep_ts, NULL);
+  // Wait for children to initialize. Pre-staged ones already had the time.
+  if (prestage_fd == -1 || !prestage_savers) {
+    struct timespec sleep_ts;
+    sleep_ts.tv_sec = saver_delay_ms / 1000;
+    sleep_ts.tv_nsec = (saver_delay_ms % 1000) * 1000000L;
+    nanosleep(&sleep_ts, NULL);
+  }
+
+#ifdef HAVE_XPRESENT_EXT
+  if (confirm_lock_present) {
+    int present_event_base, present_error_base;
+    if (XPresentQueryExtension(display, &present_opcode, &present_event_base,
+                               &present_error_base)) {
+      XPresentSelectInput(display, background_window,
+                          PresentCompleteNotifyMask);
+    } else {
+      Log("Present extension not available - confirming the lock by "
+          "visibility");
+      present_opcode = 0;
+    }
+  }
+#endif
 
   // Map our windows.
   // This is done after grabbing so failure to grab does not blank the screen
@@ -1158,9 +1344,17 @@ int main(int argc, char **argv) {
     xss_sleep_lock_fd = -1;
   }
 
+  InitXServerWatchdog();
+
+  MonitorChangeSettle monitor_change_settle = {0};
   int background_window_mapped = 0, background_window_visible = 0,
       auth_window_mapped = 0, saver_window_mapped = 0,
       need_to_reinstate_grabs = 0, xss_lock_notified = 0;
+#ifdef HAVE_XPRESENT_EXT
+  int lock_present_requested = 0, lock_presented = 0,
+      lock_present_timed_out = 0;
+  struct timeval lock_mapped_time;
+#endif
   for (;;) {
     // Watch children WATCH_CHILDREN_HZ times per second.
     fd_set in_fds;
@@ -1182,6 +1376,17 @@ int main(int argc, char **argv) {
       goto done;
     }
 
+    // Keep an eye on how responsive the X server is.
+    MaybePingXServer(display);
+
+    // Republish the monitor configuration once per burst of changes.
+    if (MonitorChangeSettled(&monitor_change_settle)) {
+      PublishMonitors(display, monitor_windows, 3);
+      if (multiplexed_saver_executable != NULL) {
+        UpdateMultiplexedMonitors();
+      }
+    }
+
     // If something changed our cursor, change it back.
     XUndefineCursor(display, saver_window);
 
@@ -1197,6 +1402,8 @@ int main(int argc, char **argv) {
         Log("Critical: could not reacquire grabs. The screen is now UNLOCKED! "
             "Trying again next frame.");
         need_to_reinstate_grabs = 1;
+      } else {
+        CountSessionEvent(SESSION_GRAB_REACQUIRE);
       }
     }
 
@@ -1441,6 +1648,7 @@ int main(int argc, char **argv) {
         case MappingNotify:
         case EnterNotify:
         case LeaveNotify:
+        case ReparentNotify:  // From moving into the overlay window.
           // Ignored.
           break;
         case MapNotify:
@@ -1545,6 +1753,18 @@ int main(int argc, char **argv) {
         default:
 #ifdef DEBUG_EVENTS
           Log("Event%d %lu", priv.ev.type, (unsigned long)priv.ev.xany.window);
+#endif
+          if (IsMonitorChangeEvent(display, &priv.ev)) {
+            NoteMonitorChange(&monitor_change_settle);
+            break;
+          }
+#ifdef HAVE_XPRESENT_EXT
+          if (IsLockPresentedEvent(display, &priv.ev)) {
+            lock_presented = 1;
+            Log("Lock presented %.1f ms after mapping",
+                MillisecondsSince(&lock_mapped_time));
+            break;
+          }
 #endif
 #ifdef HAVE_XSCREENSAVER_EXT
           // Handle screen saver notifications. If the screen is blanked
@@ -1564,15 +1784,43 @@ int main(int argc, char **argv) {
           Log("Received unexpected event %d", priv.ev.type);
           break;
       }
-      if (background_window_mapped && background_window_visible &&
-          saver_window_mapped && !xss_lock_notified) {
-        NotifyOfLock(xss_sleep_lock_fd);
+    }
+
+    if (background_window_mapped && saver_window_mapped &&
+        !xss_lock_notified) {
+      int lock_confirmed = background_window_visible;
+#ifdef HAVE_XPRESENT_EXT
+      if (present_opcode != 0 && !lock_present_timed_out) {
+        if (!lock_present_requested) {
+          // Our windows are mapped, so the next frame shows them.
+          XPresentNotifyMSC(display, background_window, LOCK_PRESENT_SERIAL, 0,
+                            1, 0);
+          gettimeofday(&lock_mapped_time, NULL);
+          lock_present_requested = 1;
+        }
+        if (!lock_presented &&
+            MillisecondsSince(&lock_mapped_time) >= LOCK_PRESENT_TIMEOUT_MS) {
+          Log("No Present notification after %d ms - confirming the lock by "
+              "visibility",
+              LOCK_PRESENT_TIMEOUT_MS);
+          lock_present_timed_out = 1;
+        } else {
+          // A presented frame alone does not say nothing covers the lock.
+          lock_confirmed = lock_presented && background_window_visible;
+        }
+      }
+#endif
+      if (lock_confirmed) {
+        NotifyOfLock(xss_sleep_lock_fd, prestage_fd);
+        SessionLocked();
         xss_lock_notified = 1;
       }
     }
   }
 
 done:
+  gettimeofday(&unlock_start, NULL);
+
   // Make sure no DPMS changes persist.
   UnblankScreen(display);
 
@@ -1586,7 +1834,9 @@ done:
   // Wipe the password.
   explicit_bzero(&priv, sizeof(priv));
 
-  // Free our resources, and exit.
+  // Release the screen right away; the saver may take a while to exit.
+  XUngrabKeyboard(display, CurrentTime);
+  XUngrabPointer(display, CurrentTime);
 #ifdef HAVE_XCOMPOSITE_EXT
   if (obscurer_window != None) {
     // Destroy the obscurer window first so it should never become visible.
@@ -1599,12 +1849,27 @@ done:
   XDestroyWindow(display, auth_window);
   XDestroyWindow(display, saver_window);
   XDestroyWindow(display, background_window);
+  XSync(display, False);
+  double release_ms = MillisecondsSince(&unlock_start);
 
+  // Free our resources, and exit.
   XFreeCursor(display, transparent_cursor);
   XFreeCursor(display, default_cursor);
   XFreePixmap(display, bg);
 
   XCloseDisplay(display);
 
+  // Only now wait for the saver children to go away.
+  ReapAllSaverChildren();
+  if (debug_timing) {
+    char histogram[256];
+    FormatXServerWatchdogHistogram(histogram, sizeof(histogram));
+    Log("Unlock: released the screen after %.1f ms, reaped savers after "
+        "%.1f ms; %d savers needed SIGKILL; X server round trips: %s",
+        release_ms, MillisecondsSince(&unlock_start),
+        GetSaverKillEscalations(), histogram);
+  }
+  WriteSessionLog();
+
   return EXIT_SUCCESS;
 }
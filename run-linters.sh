@@ -40,6 +40,7 @@ if which clang-tidy; then
     -extra-arg=-DHAVE_XCOMPOSITE_EXT \
     -extra-arg=-DHAVE_XFIXES_EXT \
     -extra-arg=-DHAVE_XKB_EXT \
+    -extra-arg=-DHAVE_XPRESENT_EXT \
     -extra-arg=-DHAVE_XFT_EXT \
     -extra-arg=-DHAVE_XRANDR_EXT \
     -extra-arg=-DHAVE_XSCREENSAVER_EXT \
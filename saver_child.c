@@ -16,17 +16,46 @@ limitations under the License.
 
 #include "saver_child.h"
 
-#include <signal.h>  // for sigemptyset, sigprocmask, SIG_SETMASK
-#include <stdlib.h>  // for NULL, EXIT_FAILURE
-#include <unistd.h>  // for pid_t, _exit, execl, fork, setsid, sleep
+#include <errno.h>     // for errno
+#include <signal.h>    // for sigemptyset, sigprocmask, SIG_SETMASK
+#include <stdlib.h>    // for NULL, EXIT_FAILURE
+#include <sys/time.h>  // for gettimeofday, timeval
+#include <time.h>      // for nanosleep, timespec
+#include <unistd.h>    // for pid_t, _exit, execl, fork, nice, setsid, sleep
 
+#include "env_settings.h"      // for GetIntSetting
 #include "logging.h"           // for LogErrno, Log
+#include "util.h"              // for MillisecondsSince
 #include "wait_pgrp.h"         // for KillPgrp, WaitPgrp
 #include "xscreensaver_api.h"  // for ExportWindowID and ExportSaverIndex
 
+//! How often to check on terminating children, in case SIGCHLD got missed.
+#define STOPPING_POLL_MS 10
+
 //! The PIDs of currently running saver children, or 0 if not running.
 static pid_t saver_child_pid[MAX_SAVERS] = {0};
 
+//! When each saver child got SIGTERM, if it is being stopped.
+static struct timeval saver_child_stopping_since[MAX_SAVERS];
+
+//! Whether each saver child is being stopped.
+static int saver_child_stopping[MAX_SAVERS] = {0};
+
+//! Whether each saver child already got SIGKILL.
+static int saver_child_killed[MAX_SAVERS] = {0};
+
+//! How many saver children needed SIGKILL so far.
+static int saver_kill_escalations = 0;
+
+//! Whether a saver child was ever started at each index.
+static int saver_child_started[MAX_SAVERS] = {0};
+
+//! How many saver children were started again at the same index so far.
+static int saver_restarts = 0;
+
+//! How much to lower the priority of each saver child.
+static int saver_child_nice[MAX_SAVERS] = {0};
+
 void KillAllSaverChildrenSigHandler(int signo) {
   // This is a signal handler, so we're not going to make this too
   // complicated. Just kill 'em all.
@@ -37,6 +66,53 @@ void KillAllSaverChildrenSigHandler(int signo) {
   }
 }
 
+static int GetStopGraceMs(void) {
+  static int grace_ms = -1;
+  if (grace_ms < 0) {
+    grace_ms = GetIntSetting("XSECURELOCK_SAVER_STOP_GRACE_MS", 1000);
+    if (grace_ms < 0) {
+      grace_ms = 0;
+    }
+  }
+  return grace_ms;
+}
+
+/*! \brief Asks a saver child to terminate, without waiting for it.
+ */
+static void StopSaverChild(int index) {
+  if (saver_child_stopping[index]) {
+    return;
+  }
+  KillPgrp(saver_child_pid[index], SIGTERM);
+  gettimeofday(&saver_child_stopping_since[index], NULL);
+  saver_child_stopping[index] = 1;
+}
+
+/*! \brief Checks whether a saver child is gone, escalating to SIGKILL if it
+ * did not stop within the grace period.
+ *
+ * \return If true, the child just terminated.
+ */
+static int PollSaverChild(int index) {
+  if (saver_child_stopping[index] && !saver_child_killed[index] &&
+      MillisecondsSince(&saver_child_stopping_since[index]) >=
+          GetStopGraceMs()) {
+    Log("Saver child did not terminate within %d ms; killing it",
+        GetStopGraceMs());
+    KillPgrp(saver_child_pid[index], SIGKILL);
+    saver_child_killed[index] = 1;
+    ++saver_kill_escalations;
+  }
+  int status;
+  if (!WaitPgrp("saver", &saver_child_pid[index], 0,
+                saver_child_stopping[index], &status)) {
+    return 0;
+  }
+  saver_child_stopping[index] = 0;
+  saver_child_killed[index] = 0;
+  return 1;
+}
+
 void WatchSaverChild(Display* dpy, Window w, int index, const char* executable,
                      int should_be_running) {
   if (index < 0 || index >= MAX_SAVERS) {
@@ -46,17 +122,16 @@ void WatchSaverChild(Display* dpy, Window w, int index, const char* executable,
 
   if (saver_child_pid[index] != 0) {
     if (!should_be_running) {
-      KillPgrp(saver_child_pid[index], SIGTERM);
+      StopSaverChild(index);
     }
 
-    int status;
-    if (WaitPgrp("saver", &saver_child_pid[index], !should_be_running,
-                 !should_be_running, &status)) {
+    if (PollSaverChild(index)) {
       // Now is the time to remove anything the child may have displayed.
       XClearWindow(dpy, w);
     }
   }
 
+  // Note: a child that is still stopping blocks starting a new one.
   if (should_be_running && saver_child_pid[index] == 0) {
     pid_t pid = ForkWithoutSigHandlers();
     if (pid == -1) {
@@ -66,6 +141,12 @@ void WatchSaverChild(Display* dpy, Window w, int index, const char* executable,
       StartPgrp();
       ExportWindowID(w);
       ExportSaverIndex(index);
+      if (saver_child_nice[index] != 0) {
+        errno = 0;
+        if (nice(saver_child_nice[index]) == -1 && errno != 0) {
+          LogErrno("nice");
+        }
+      }
 
       {
         const char* args[3] = {
@@ -79,6 +160,54 @@ void WatchSaverChild(Display* dpy, Window w, int index, const char* executable,
     } else {
       // Parent process after successful fork.
       saver_child_pid[index] = pid;
+      if (saver_child_started[index]) {
+        ++saver_restarts;
+      }
+      saver_child_started[index] = 1;
+    }
+  }
+}
+
+void WatchStoppingSaverChildren(void) {
+  for (int i = 0; i < MAX_SAVERS; ++i) {
+    if (saver_child_pid[i] != 0 && saver_child_stopping[i]) {
+      PollSaverChild(i);
+    }
+  }
+}
+
+int SaverChildrenTimeoutMs(void) {
+  for (int i = 0; i < MAX_SAVERS; ++i) {
+    if (saver_child_pid[i] != 0 && saver_child_stopping[i]) {
+      return STOPPING_POLL_MS;
+    }
+  }
+  return -1;
+}
+
+int GetSaverKillEscalations(void) { return saver_kill_escalations; }
+
+int GetSaverRestarts(void) { return saver_restarts; }
+
+void SetSaverChildNice(int index, int increment) {
+  saver_child_nice[index] = increment;
+}
+
+void ReapAllSaverChildren(void) {
+  for (;;) {
+    int running = 0;
+    for (int i = 0; i < MAX_SAVERS; ++i) {
+      if (saver_child_pid[i] != 0) {
+        StopSaverChild(i);
+        running |= !PollSaverChild(i);
+      }
+    }
+    if (!running) {
+      return;
     }
+    struct timespec sleep_ts;
+    sleep_ts.tv_sec = 0;
+    sleep_ts.tv_nsec = STOPPING_POLL_MS * 1000000L;
+    nanosleep(&sleep_ts, NULL);
   }
 }
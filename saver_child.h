@@ -37,9 +37,52 @@ void KillAllSaverChildrenSigHandler(int signo);
  * \param executable What binary to spawn for screen saving. No arguments will
  *   be passed.
  * \param should_be_running If true, the saver child is started if not running
- *   yet; if alse, the saver child will be terminated.
+ *   yet; if alse, the saver child will be terminated. Termination does not
+ *   block: the child gets SIGTERM, and later calls escalate to SIGKILL once
+ *   XSECURELOCK_SAVER_STOP_GRACE_MS passed, and reap it.
  */
 void WatchSaverChild(Display* dpy, Window w, int index, const char* executable,
                      int should_be_running);
 
+/*! \brief Sets how much lower the CPU priority of a saver child is.
+ *
+ * Takes effect the next time the saver child is started. On Linux, this also
+ * lowers its I/O priority, which by default follows the CPU priority.
+ *
+ * \param index The index of the saver (0 <= index < MAX_SAVERS).
+ * \param increment The value to pass to nice(); 0 to keep our priority.
+ */
+void SetSaverChildNice(int index, int increment);
+
+/*! \brief Makes progress on terminating saver children.
+ *
+ * Needed for children that WatchSaverChild is no longer called for, e.g. when
+ * there are fewer monitors now.
+ */
+void WatchStoppingSaverChildren(void);
+
+/*! \brief Returns how soon WatchStoppingSaverChildren should be called again.
+ *
+ * \return The time in milliseconds, or -1 if no child is terminating.
+ */
+int SaverChildrenTimeoutMs(void);
+
+/*! \brief Returns how many saver children needed SIGKILL so far.
+ */
+int GetSaverKillEscalations(void);
+
+/*! \brief Returns how many saver children were started again so far.
+ *
+ * Only starts at an index that already had a saver child count, so that
+ * running one saver per monitor does not count as restarts.
+ */
+int GetSaverRestarts(void);
+
+/*! \brief Terminates all saver children and waits for them.
+ *
+ * Unlike WatchSaverChild, this does not touch the saver windows, so it can be
+ * used after they have been destroyed.
+ */
+void ReapAllSaverChildren(void);
+
 #endif
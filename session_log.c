@@ -0,0 +1,145 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "session_log.h"
+
+#include <fcntl.h>         // for open, O_APPEND, O_CREAT, O_WRONLY
+#include <stdio.h>         // for snprintf
+#include <string.h>        // for memset, strlen
+#include <sys/resource.h>  // for getrusage, rusage, RUSAGE_CHILDREN
+#include <sys/time.h>      // for gettimeofday, timeval
+#include <unistd.h>        // for close, write
+
+#include "env_settings.h"  // for GetStringSetting
+#include "logging.h"       // for Log, LogErrno
+#include "saver_child.h"   // for GetSaverRestarts, GetSaverKillEsca...
+#include "util.h"          // for MillisecondsBetween
+
+//! The file to append the session records to, or empty if disabled.
+static const char* session_log_path = "";
+static unsigned long counts[SESSION_EVENT_COUNT];
+static struct timeval session_start;
+static struct timeval session_locked;
+static int locked;
+//! When the auth child was started the last time.
+static struct timeval last_wake;
+static struct timeval session_authenticated;
+static int authenticated;
+
+static double Seconds(const struct timeval* t) {
+  return t->tv_sec + t->tv_usec / 1000000.0;
+}
+
+/*! \brief Formats a duration for JSON, or null if it did not happen.
+ */
+static void FormatMilliseconds(char* buf, size_t size, int happened,
+                               const struct timeval* from,
+                               const struct timeval* to) {
+  if (happened) {
+    snprintf(buf, size, "%.1f", MillisecondsBetween(from, to));
+  } else {
+    snprintf(buf, size, "null");
+  }
+}
+
+void InitSessionLog(void) {
+  session_log_path = GetStringSetting("XSECURELOCK_SESSION_LOG", "");
+  memset(counts, 0, sizeof(counts));
+  gettimeofday(&session_start, NULL);
+  locked = 0;
+  authenticated = 0;
+}
+
+void CountSessionEvent(enum SessionEvent event) {
+  ++counts[event];
+  if (event == SESSION_WAKE) {
+    gettimeofday(&last_wake, NULL);
+  }
+}
+
+void SessionLocked(void) {
+  gettimeofday(&session_locked, NULL);
+  locked = 1;
+}
+
+void SessionAuthenticated(void) {
+  gettimeofday(&session_authenticated, NULL);
+  authenticated = 1;
+}
+
+void WriteSessionLog(void) {
+  if (!*session_log_path || !locked) {
+    return;
+  }
+
+  struct timeval session_end;
+  gettimeofday(&session_end, NULL);
+  char time_to_lock_ms[32], auth_ms[32];
+  FormatMilliseconds(time_to_lock_ms, sizeof(time_to_lock_ms), 1,
+                     &session_start, &session_locked);
+  FormatMilliseconds(auth_ms, sizeof(auth_ms), authenticated, &last_wake,
+                     &session_authenticated);
+
+  // ru_maxrss is the peak of a single process: for RUSAGE_CHILDREN, of the
+  // biggest child (or grandchild) that has been waited for.
+  struct rusage self_usage, children_usage;
+  if (getrusage(RUSAGE_SELF, &self_usage)) {
+    LogErrno("getrusage");
+    memset(&self_usage, 0, sizeof(self_usage));
+  }
+  if (getrusage(RUSAGE_CHILDREN, &children_usage)) {
+    LogErrno("getrusage");
+    memset(&children_usage, 0, sizeof(children_usage));
+  }
+
+  char buf[1024];
+  int len = snprintf(
+      buf, sizeof(buf),
+      "{\"start\":%.3f,\"end\":%.3f,\"time_to_lock_ms\":%s,\"wakes\":%lu,"
+      "\"auth_dialogs\":%lu,\"auth_dialogs_unsuccessful\":%lu,"
+      "\"auth_ms\":%s,"
+      "\"saver_restarts\":%d,\"saver_freezes\":%d,\"blanks\":%lu,"
+      "\"unblanks\":%lu,\"grab_reacquires\":%lu,\"raises\":%lu,"
+      "\"peak_rss_kb\":%ld,\"peak_child_rss_kb\":%ld}\n",
+      Seconds(&session_start), Seconds(&session_end), time_to_lock_ms,
+      counts[SESSION_WAKE],
+      counts[SESSION_AUTH_UNSUCCESSFUL] + (unsigned long)authenticated,
+      counts[SESSION_AUTH_UNSUCCESSFUL], auth_ms,
+      GetSaverRestarts(), GetSaverKillEscalations(),
+      counts[SESSION_BLANK], counts[SESSION_UNBLANK],
+      counts[SESSION_GRAB_REACQUIRE], counts[SESSION_RAISE],
+      (long)self_usage.ru_maxrss, (long)children_usage.ru_maxrss);
+  if (len < 0 || (size_t)len >= sizeof(buf)) {
+    Log("Session log record too long");
+    return;
+  }
+
+  // A single write with O_APPEND keeps records intact even if several
+  // instances share the file.
+  int fd = open(session_log_path, O_WRONLY | O_APPEND | O_CREAT | O_NOCTTY,
+                0600);
+  if (fd < 0) {
+    LogErrno("open %s", session_log_path);
+    return;
+  }
+  ssize_t written = write(fd, buf, len);
+  if (written < 0) {
+    LogErrno("write %s", session_log_path);
+  } else if (written != len) {
+    Log("Short write to %s", session_log_path);
+  }
+  close(fd);
+}
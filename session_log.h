@@ -0,0 +1,72 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+//! Things that happen during a lock session and get counted.
+enum SessionEvent {
+  //! The auth child was started, i.e. the user woke up the lock.
+  SESSION_WAKE,
+  //! The auth child exited without authenticating the user: the password was
+  //! rejected, or the prompt timed out or got cancelled, which auth children
+  //! do not tell apart.
+  SESSION_AUTH_UNSUCCESSFUL,
+  //! The screen got blanked by us.
+  SESSION_BLANK,
+  //! The screen got unblanked.
+  SESSION_UNBLANK,
+  //! The grabs had to be acquired again.
+  SESSION_GRAB_REACQUIRE,
+  //! One of our windows had to be raised again.
+  SESSION_RAISE,
+  SESSION_EVENT_COUNT
+};
+
+/*! \brief Starts a new lock session.
+ *
+ * Reads XSECURELOCK_SESSION_LOG; if it is empty, the session log is disabled,
+ * but the events are still counted.
+ */
+void InitSessionLog(void);
+
+/*! \brief Counts an event of the current lock session.
+ */
+void CountSessionEvent(enum SessionEvent event);
+
+/*! \brief Records that the screen is now locked.
+ */
+void SessionLocked(void);
+
+/*! \brief Records that the user authenticated successfully.
+ */
+void SessionAuthenticated(void);
+
+/*! \brief Appends the record of the lock session to XSECURELOCK_SESSION_LOG.
+ *
+ * The record is a single JSON object on a single line. It contains only
+ * timings and counters - nothing the user typed.
+ *
+ * Does nothing unless SessionLocked was called, so pre-staged lockers that got
+ * aborted, and spare lockers, do not leave records of sessions that never
+ * happened.
+ *
+ * Meant to be called once all children have been reaped, so their peak RSS is
+ * known.
+ */
+void WriteSessionLog(void);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "supervisor.h"
+
+#include <errno.h>     // for EINTR, errno
+#include <signal.h>    // for sigaction, kill, raise, SIGTERM, SIGUSR2
+#include <stdlib.h>    // for EXIT_FAILURE, EXIT_SUCCESS, setenv, unsetenv
+#include <sys/wait.h>  // for waitpid, WIFEXITED, WEXITSTATUS, WTERMSIG
+#include <unistd.h>    // for close, pid_t, sleep
+
+#include "helpers/prestage.h"  // for StartPrestagedLocker, CommitPrestag...
+#include "logging.h"           // for Log, LogErrno
+#include "wait_pgrp.h"         // for KillPgrp
+
+//! The locker that currently holds the lock, or 0 if none.
+static volatile pid_t active_pid = 0;
+
+//! The pre-staged locker waiting to take over, or 0 if none.
+static volatile pid_t spare_pid = 0;
+
+static void HandleSIGTERM(int signo) {
+  if (active_pid != 0) {
+    KillPgrp(active_pid, signo);
+  }
+  if (spare_pid != 0) {
+    KillPgrp(spare_pid, signo);
+  }
+  raise(signo);
+}
+
+static void HandleSIGUSR2(int signo) {
+  // Wakeup requests are meant for the locker that is showing.
+  if (active_pid != 0) {
+    kill(active_pid, signo);
+  }
+}
+
+/*! \brief Starts a spare locker.
+ *
+ * \return The socket to commit it with, or -1 on failure.
+ */
+static int StartSpare(char **argv) {
+  // The active locker's savers are running already; the spare only starts its
+  // own once committed.
+  setenv("XSECURELOCK_SUPERVISOR_SPARE", "1", 1);
+  pid_t pid;
+  int fd = StartPrestagedLocker(argv, &pid);
+  unsetenv("XSECURELOCK_SUPERVISOR_SPARE");
+  spare_pid = (fd == -1) ? 0 : pid;
+  return fd;
+}
+
+static void LogLockerDeath(int status) {
+  if (WIFSIGNALED(status)) {
+    Log("Locker got killed by signal %d - relocking", WTERMSIG(status));
+  } else {
+    Log("Locker exited with status %d - relocking", WEXITSTATUS(status));
+  }
+}
+
+int Supervise(char **argv, int xss_sleep_lock_fd, int prestage_fd) {
+  // The lockers must not supervise again, and we handle the sleep lock.
+  setenv("XSECURELOCK_SUPERVISE", "0", 1);
+  unsetenv("XSS_SLEEP_LOCK_FD");
+
+  struct sigaction sa;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = 0;
+  sa.sa_handler = SIG_IGN;  // Don't die if a locker closes its socket.
+  if (sigaction(SIGPIPE, &sa, NULL) != 0) {
+    LogErrno("sigaction(SIGPIPE)");
+  }
+  sa.sa_handler = HandleSIGUSR2;  // For remote wakeups by system events.
+  if (sigaction(SIGUSR2, &sa, NULL) != 0) {
+    LogErrno("sigaction(SIGUSR2)");
+  }
+  sa.sa_flags = SA_RESETHAND;     // It re-raises to suicide.
+  sa.sa_handler = HandleSIGTERM;  // To kill the lockers.
+  if (sigaction(SIGTERM, &sa, NULL) != 0) {
+    LogErrno("sigaction(SIGTERM)");
+  }
+
+  // The first locker gets committed right away - or when whoever pre-staged
+  // us says so.
+  pid_t pid;
+  int active_fd = StartPrestagedLocker(argv, &pid);
+  if (active_fd == -1) {
+    return EXIT_FAILURE;
+  }
+  active_pid = pid;
+  if (prestage_fd != -1 && !WaitForPrestageCommit(prestage_fd)) {
+    // User activity during dimming. Closing the socket aborts the locker.
+    close(active_fd);
+    close(prestage_fd);
+    KillPgrp(pid, SIGTERM);
+    return EXIT_SUCCESS;
+  }
+  if (!CommitPrestagedLocker(active_fd)) {
+    close(active_fd);
+    return EXIT_FAILURE;
+  }
+  close(active_fd);
+  if (xss_sleep_lock_fd != -1) {
+    if (close(xss_sleep_lock_fd) != 0) {
+      LogErrno("close(XSS_SLEEP_LOCK_FD)");
+    }
+  }
+  if (prestage_fd != -1) {
+    ConfirmPrestagedLock(prestage_fd);
+  }
+
+  int spare_fd = StartSpare(argv);
+  for (;;) {
+    int status;
+    pid_t died = waitpid(-1, &status, 0);
+    if (died == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LogErrno("waitpid");
+      return EXIT_FAILURE;
+    }
+
+    // Like WaitPgrp, kill what is left of the process group of the locker,
+    // which at least includes its pgrp_placeholder.
+    if (died == spare_pid || died == active_pid) {
+      KillPgrp(died, SIGTERM);
+    }
+
+    if (died == spare_pid) {
+      Log("Spare locker died - starting a new one");
+      close(spare_fd);
+      spare_pid = 0;
+      sleep(1);  // Reduce log spam if it keeps failing.
+      spare_fd = StartSpare(argv);
+      continue;
+    }
+    if (died != active_pid) {
+      continue;
+    }
+    active_pid = 0;
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+      // Unlocked. Closing the socket makes the spare exit by itself, but its
+      // process group would stay.
+      if (spare_fd != -1) {
+        close(spare_fd);
+        KillPgrp(spare_pid, SIGTERM);
+      }
+      return EXIT_SUCCESS;
+    }
+
+    LogLockerDeath(status);
+    if (spare_fd == -1) {
+      spare_fd = StartSpare(argv);
+    }
+    if (spare_fd == -1 || !CommitPrestagedLocker(spare_fd)) {
+      Log("Critical: could not relock. The screen is now UNLOCKED!");
+      if (spare_fd != -1) {
+        close(spare_fd);
+      }
+      return EXIT_FAILURE;
+    }
+    close(spare_fd);
+    active_pid = spare_pid;
+    spare_fd = StartSpare(argv);
+  }
+}
@@ -0,0 +1,34 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+/*! \brief Runs the actual locker as a child, and relocks if it crashes.
+ *
+ * Besides the active locker, a pre-staged spare locker is kept around, with
+ * its display connection open and windows created. Should the active locker
+ * die without a successful authentication, the spare gets committed, which
+ * locks the screen again right away, and a new spare is started.
+ *
+ * \param argv Our own command line; the lockers get run with it.
+ * \param xss_sleep_lock_fd The XSS_SLEEP_LOCK_FD to close once locked, or -1.
+ * \param prestage_fd Our own XSECURELOCK_PRESTAGE_FD, or -1.
+ * \return The exit status for xsecurelock.
+ */
+int Supervise(char **argv, int xss_sleep_lock_fd, int prestage_fd);
+
+#endif
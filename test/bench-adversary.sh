@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# Copyright 2018 Google Inc. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Benchmarks the lock against clients fighting it for grabs and stacking, on a
+# headless X server.
+#
+# Usage: ./bench-adversary.sh [repetitions [raise_war_seconds]]
+#
+# Normally run via "make bench". Like bench.sh, this uses the installed
+# binaries. Needs Xvfb (or set XSERVER).
+#
+# Results go to bench-results/<git revision>-adversary.jsonl, which
+# bench-compare.sh can compare as well.
+
+set -e
+
+repetitions=${1:-30}
+raise_war_seconds=${2:-10}
+builddir=${BUILDDIR:-.}
+srcdir=${SRCDIR:-$(dirname "$0")/..}
+bindir=${BINDIR:-/usr/local/bin}
+display=${BENCH_DISPLAY:-:46}
+
+if ! [ -x "$bindir"/xsecurelock ]; then
+  echo >&2 "$bindir/xsecurelock not found; run make install first."
+  exit 1
+fi
+
+revision=$(cd "$srcdir" && git describe --always --dirty 2>/dev/null ||
+           echo unknown)
+mkdir -p "$builddir"/bench-results
+results="$builddir/bench-results/$revision-adversary.jsonl"
+
+"${XSERVER:-Xvfb}" "$display" -nolisten tcp -screen 0 640x480x24 \
+  > /dev/null 2>&1 & xserver=$!
+trap 'kill "$xserver"' EXIT
+export DISPLAY="$display"
+for i in $(seq 50); do
+  [ -e /tmp/.X11-unix/X"${display#:}" ] && break
+  sleep 0.1
+done
+
+# No input is ever sent, so the auth dialog never shows.
+XSECURELOCK_SAVER=saver_blank \
+XSECURELOCK_NO_COMPOSITE=1 \
+  "$builddir"/bench_adversary "$bindir"/xsecurelock \
+    "$repetitions" "$raise_war_seconds" \
+    2> "$builddir"/bench-results/"$revision"-adversary.log > "$results"
+cat "$results"
@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Copyright 2018 Google Inc. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Compares the medians and 90th percentiles of two bench.sh results.
+#
+# Usage: ./bench-compare.sh old.jsonl new.jsonl
+
+set -e
+
+if [ $# -ne 2 ]; then
+  echo >&2 "Usage: $0 old.jsonl new.jsonl"
+  exit 1
+fi
+
+# bench_lock writes one flat object per line, so no JSON parser is needed.
+awk '
+  {
+    delete v
+    n = split($0, kv, /[{},]/)
+    for (i = 1; i <= n; ++i) {
+      if (split(kv[i], p, ":") == 2) {
+        gsub(/"/, "", p[1])
+        gsub(/"/, "", p[2])
+        v[p[1]] = p[2]
+      }
+    }
+  }
+  FNR == NR { p50[v["metric"]] = v["p50"]; p90[v["metric"]] = v["p90"]; next }
+  v["metric"] in p50 {
+    m = v["metric"]
+    printf "%-24s p50 %10.3f -> %10.3f (%+6.1f%%)  p90 %10.3f -> %10.3f (%+6.1f%%)\n",
+      m, p50[m], v["p50"], p50[m] ? (v["p50"] / p50[m] - 1) * 100 : 0,
+      p90[m], v["p90"], p90[m] ? (v["p90"] / p90[m] - 1) * 100 : 0
+  }
+' "$1" "$2"
@@ -0,0 +1,111 @@
+#!/bin/sh
+#
+# Copyright 2018 Google Inc. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Benchmarks monitor queries on a headless X server with 1 to 64 synthetic
+# monitors in disjoint, overlapping and cloned layouts.
+#
+# The synthetic monitors come from xrandr --setmonitor, which adds no CRTCs or
+# outputs, so only the XRandR 1.5 path sees them. The XRandR 1.2 and guess
+# paths are therefore only measured once, on the server's own output
+# (layout=outputs), and reported as skipped for the synthetic layouts.
+#
+# Usage: ./bench-monitors.sh [iterations]
+#
+# Run from the test directory of a build tree; override BUILDDIR otherwise.
+# Needs Xvfb (or set XSERVER, e.g. to Xephyr) and xrandr.
+
+set -e
+
+iterations=${1:-100}
+builddir=${BUILDDIR:-..}
+srcdir=${SRCDIR:-$(dirname "$0")/..}
+display=${BENCH_DISPLAY:-:43}
+
+# Screen size; the 64 monitor layouts are an 8x8 grid on it.
+width=4096
+height=2048
+
+"${XSERVER:-Xvfb}" "$display" -nolisten tcp -screen 0 "${width}x${height}x24" \
+  > /dev/null 2>&1 & xserver=$!
+trap 'kill "$xserver"' EXIT
+export DISPLAY="$display"
+for i in $(seq 50); do
+  xrandr > /dev/null 2>&1 && break
+  sleep 0.1
+done
+
+# Assigning the output to the first synthetic monitor removes the automatic
+# monitor covering the whole screen, which would hide all others.
+output=$(xrandr | awk '$2 == "connected" { print $1; exit }')
+
+clear_monitors() {
+  for name in $(xrandr --listmonitors |
+                 awk '/bench/ { sub(/^[+*]*/, "", $2); print $2 }'); do
+    xrandr --delmonitor "$name"
+  done
+}
+
+set_layout() {
+  layout=$1
+  n=$2
+  cols=1
+  while [ $((cols * cols)) -lt "$n" ]; do
+    cols=$((cols + 1))
+  done
+  w=$((width / cols))
+  h=$((height / cols))
+  for i in $(seq 0 $((n - 1))); do
+    case "$layout" in
+      disjoint)
+        x=$((i % cols * w))
+        y=$((i / cols * h))
+        mw=$w
+        mh=$h
+        ;;
+      overlapping)
+        x=$((i % cols * w / 2))
+        y=$((i / cols * h / 2))
+        mw=$w
+        mh=$h
+        ;;
+      cloned)
+        x=0
+        y=0
+        mw=$((width / 2))
+        mh=$((height / 2))
+        ;;
+    esac
+    outputs=none
+    if [ "$i" = 0 ] && [ -n "$output" ]; then
+      outputs=$output
+    fi
+    xrandr --setmonitor "bench$i" "$mw/$mw"x"$mh/$mh+$x+$y" "$outputs"
+  done
+}
+
+"$builddir"/bench_monitors "$iterations" 2> bench-monitors-outputs.log |\
+  sed -e "s/^/layout=outputs monitors=1 /"
+
+for layout in disjoint overlapping cloned; do
+  for n in 1 2 4 8 16 32 64; do
+    clear_monitors
+    set_layout "$layout" "$n"
+    "$builddir"/bench_monitors "$iterations" \
+      "$builddir"/saver_multiplex "$(cd "$srcdir" && pwd)"/helpers/saver_blank \
+      2> "bench-monitors-$layout-$n.log" |\
+    sed -e "s/^/layout=$layout monitors=$n /"
+  done
+done
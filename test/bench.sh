@@ -0,0 +1,85 @@
+#!/bin/sh
+#
+# Copyright 2018 Google Inc. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Benchmarks locking and unlocking end to end on a headless X server.
+#
+# Usage: ./bench.sh [repetitions [idle_seconds [idle_repetitions]]]
+#
+# The idle CPU, wakeup and memory metrics are measured for idle_seconds in
+# idle_repetitions of the repetitions (default 5), as each of these takes that
+# long.
+#
+# Normally run via "make bench". As the helpers only run from their install
+# location, this uses the installed binaries; configure with a private prefix
+# (e.g. --prefix="$PWD/_bench") and "make install" to benchmark a checkout.
+# Needs Xvfb (or set XSERVER) and htpasswd.
+#
+# Results go to bench-results/<git revision>.jsonl, one JSON object per metric;
+# compare two of them with bench-compare.sh.
+
+set -e
+
+repetitions=${1:-20}
+idle_seconds=${2:-60}
+idle_repetitions=${3:-5}
+builddir=${BUILDDIR:-.}
+srcdir=${SRCDIR:-$(dirname "$0")/..}
+bindir=${BINDIR:-/usr/local/bin}
+helperdir=${HELPERDIR:-/usr/local/libexec/xsecurelock}
+display=${BENCH_DISPLAY:-:44}
+
+for f in "$bindir"/xsecurelock "$helperdir"/auth_x11 \
+         "$helperdir"/authproto_htpasswd "$helperdir"/saver_blank; do
+  if ! [ -x "$f" ]; then
+    echo >&2 "$f not found; run make install first."
+    exit 1
+  fi
+done
+if ! [ -x "$builddir"/bench_lock ]; then
+  echo >&2 "bench_lock not found; it needs the XTest library to build."
+  exit 1
+fi
+
+revision=$(cd "$srcdir" && git describe --always --dirty 2>/dev/null ||
+           echo unknown)
+mkdir -p "$builddir"/bench-results
+results="$builddir/bench-results/$revision.jsonl"
+
+# An isolated homedir with a fixed password.
+homedir=$(mktemp -d -t xsecurelock-bench.XXXXXX)
+htpasswd -bc "$homedir/.xsecurelock.pw" "$USER" hunter2 2>/dev/null
+
+# With -retro, the desktop has a pattern that tells it apart from the lock.
+"${XSERVER:-Xvfb}" "$display" -nolisten tcp -retro -screen 0 640x480x24 \
+  > /dev/null 2>&1 & xserver=$!
+trap 'kill "$xserver"; rm -rf "$homedir"' EXIT
+export DISPLAY="$display"
+for i in $(seq 50); do
+  [ -e /tmp/.X11-unix/X"${display#:}" ] && break
+  sleep 0.1
+done
+
+HOME="$homedir" \
+XSECURELOCK_AUTH=auth_x11 \
+XSECURELOCK_AUTHPROTO=authproto_htpasswd \
+XSECURELOCK_SAVER=saver_blank \
+XSECURELOCK_AUTH_CURSOR_BLINK=0 \
+XSECURELOCK_SHOW_DATETIME=0 \
+XSECURELOCK_WANT_FIRST_KEYPRESS=0 \
+  "$builddir"/bench_lock "$bindir"/xsecurelock \
+    "$repetitions" "$idle_seconds" hunter2 "$idle_repetitions" \
+    2> "$builddir"/bench-results/"$revision".log > "$results"
+cat "$results"
@@ -0,0 +1,380 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief Lock benchmark against hostile X11 clients.
+ *
+ *Plays the clients that fight a screen lock for input and stacking, and
+ *measures how xsecurelock copes, reporting JSON lines like bench_lock:
+ *
+ *- grab_after_release_ms: xsecurelock gets started while we hold the keyboard
+ *  grab, the pointer grab, or both along with an open override-redirect
+ *  "menu", for a random duration below xsecurelock's retry window, counted
+ *  from when its windows appear; this is the time from our release until the
+ *  lock is confirmed.
+ *- grab_failures: how many of these locks gave up on grabbing.
+ *- restack_ms: from raising an override-redirect window above the lock until
+ *  the lock's background window is on top again.
+ *- remap_ms: from unmapping the lock's background window until it is viewable
+ *  again.
+ *- raise_war_cpu_percent: CPU time of the lock process tree while we raise
+ *  our window in a tight loop.
+ *- raise_war_on_top_percent: how often the lock was on top when we checked
+ *  during the raise war.
+ *
+ *Usage:
+ *  bench_adversary /path/to/xsecurelock repetitions raise_war_seconds
+ *
+ *Normally run by bench-adversary.sh, which sets up the X server and the
+ *environment. Does not need XTest, as it never fakes input.
+ */
+
+#include <X11/X.h>     // for Window, None, GrabModeAsync, IsViewable
+#include <X11/Xlib.h>  // for XGrabKeyboard, XRaiseWindow, XUnmapWindow
+#include <poll.h>      // for poll, pollfd, POLLIN
+#include <signal.h>    // for kill, SIGTERM
+#include <stdio.h>     // for fprintf, perror, snprintf, stderr
+#include <stdlib.h>    // for atoi, exit, rand, setenv, srand
+#include <sys/time.h>  // for gettimeofday, timeval
+#include <sys/wait.h>  // for waitpid
+#include <unistd.h>    // for close, execl, fork, pipe, sysconf, usleep
+
+#include "bench_samples.h"  // for AddSample, PrintSamples, Samples
+#include "lock_windows.h"   // for FindWindow, IsAbove
+#include "proc_tree.h"      // for GetTreeStats, TreeStats
+#include "../util.h"        // for MillisecondsBetween, MillisecondsSince
+
+//! How long to wait for anything to happen before giving up.
+#define TIMEOUT_MS 10000
+
+//! How long we hold grabs at most after xsecurelock created its windows; from
+//! then on it retries grabbing for about a second.
+#define MAX_HOLD_MS 800
+
+//! How long to sleep between checks of the lock's windows.
+#define POLL_US 500
+
+//! How long xsecurelock may take to exit after closing XSS_SLEEP_LOCK_FD, for
+//! this to count as giving up rather than locking.
+#define EXIT_GRACE_MS 100
+
+static struct Samples grab_after_release = {"grab_after_release_ms", NULL, 0,
+                                            0};
+static struct Samples grab_failures = {"grab_failures", NULL, 0, 0};
+static struct Samples restack = {"restack_ms", NULL, 0, 0};
+static struct Samples remap = {"remap_ms", NULL, 0, 0};
+static struct Samples raise_war_cpu = {"raise_war_cpu_percent", NULL, 0, 0};
+static struct Samples raise_war_on_top = {"raise_war_on_top_percent", NULL, 0,
+                                          0};
+
+//! The ways in which we keep xsecurelock from grabbing.
+enum GrabKind { GRAB_KEYBOARD, GRAB_POINTER, GRAB_MENU, GRAB_KIND_COUNT };
+
+/*! \brief Starts xsecurelock.
+ *
+ * \param lock_fd Receives a pipe that gets closed once the screen is locked.
+ * \return The PID of xsecurelock.
+ */
+static pid_t StartLock(const char *xsecurelock, int *lock_fd) {
+  int fds[2];
+  if (pipe(fds) == -1) {
+    perror("pipe");
+    exit(1);
+  }
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    exit(1);
+  } else if (pid == 0) {
+    char fd_str[16];
+    snprintf(fd_str, sizeof(fd_str), "%d", fds[1]);
+    setenv("XSS_SLEEP_LOCK_FD", fd_str, 1);
+    close(fds[0]);
+    execl(xsecurelock, xsecurelock, (char *)NULL);
+    perror("execl");
+    _exit(1);
+  }
+  close(fds[1]);
+  *lock_fd = fds[0];
+  return pid;
+}
+
+/*! \brief Waits until xsecurelock reports the lock, or exits.
+ *
+ * \param locked_at If not NULL, receives when the lock got reported.
+ * \return Whether the screen got locked.
+ */
+static int WaitForLock(pid_t pid, int lock_fd, struct timeval *locked_at) {
+  // xsecurelock closes the fd once locked; children don't inherit it. If it
+  // gives up instead, the fd gets closed by its exit.
+  struct pollfd pfd = {lock_fd, POLLIN, 0};
+  char c;
+  int closed = poll(&pfd, 1, TIMEOUT_MS) == 1 && read(lock_fd, &c, 1) == 0;
+  struct timeval closed_at;
+  gettimeofday(&closed_at, NULL);
+  close(lock_fd);
+  if (!closed) {
+    return 0;
+  }
+  // Tell the two apart: a locked xsecurelock keeps running.
+  while (MillisecondsSince(&closed_at) < EXIT_GRACE_MS) {
+    int status;
+    if (waitpid(pid, &status, WNOHANG) != 0) {
+      return 0;
+    }
+    usleep(POLL_US);
+  }
+  if (locked_at != NULL) {
+    *locked_at = closed_at;
+  }
+  return 1;
+}
+
+/*! \brief Waits until xsecurelock created its windows, which it does right
+ * before it starts trying to grab.
+ */
+static void WaitForLockWindows(Display *display) {
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  while (FindWindow(display, DefaultRootWindow(display), "background") ==
+         None) {
+    if (MillisecondsSince(&start) > TIMEOUT_MS) {
+      fprintf(stderr, "xsecurelock did not create its windows.\n");
+      exit(1);
+    }
+    usleep(POLL_US);
+  }
+}
+
+/*! \brief Terminates xsecurelock, which unlocks the screen.
+ *
+ * \return Whether xsecurelock was still running.
+ */
+static int StopLock(pid_t pid) {
+  int status;
+  int running = waitpid(pid, &status, WNOHANG) == 0;
+  if (running) {
+    kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+  }
+  return running;
+}
+
+static Window CreateOverrideRedirectWindow(Display *display, int x, int y,
+                                           int w, int h) {
+  int screen = DefaultScreen(display);
+  XSetWindowAttributes attrs = {0};
+  attrs.override_redirect = True;
+  attrs.background_pixel = WhitePixel(display, screen);
+  return XCreateWindow(display, RootWindow(display, screen), x, y, w, h, 0,
+                       CopyFromParent, InputOutput, CopyFromParent,
+                       CWOverrideRedirect | CWBackPixel, &attrs);
+}
+
+/*! \brief Locks while we hold grabs the way some client would.
+ */
+static void BenchGrab(Display *display, const char *xsecurelock,
+                      enum GrabKind kind, int hold_ms, int *failures) {
+  Window root = DefaultRootWindow(display);
+  Window menu = None;
+  if (kind == GRAB_MENU) {
+    // Like a popup menu: a mapped override-redirect window with all input.
+    menu = CreateOverrideRedirectWindow(display, 10, 10, 100, 200);
+    XMapRaised(display, menu);
+  }
+  if (kind != GRAB_POINTER &&
+      XGrabKeyboard(display, root, False, GrabModeAsync, GrabModeAsync,
+                    CurrentTime) != GrabSuccess) {
+    fprintf(stderr, "Could not grab the keyboard.\n");
+    exit(1);
+  }
+  if (kind != GRAB_KEYBOARD &&
+      XGrabPointer(display, root, False, ButtonPressMask, GrabModeAsync,
+                   GrabModeAsync, None, None, CurrentTime) != GrabSuccess) {
+    fprintf(stderr, "Could not grab the pointer.\n");
+    exit(1);
+  }
+  XSync(display, False);
+
+  int lock_fd;
+  pid_t pid = StartLock(xsecurelock, &lock_fd);
+  // Its startup time must not eat into the hold, or we would not get near
+  // the end of its retry window.
+  WaitForLockWindows(display);
+  usleep(hold_ms * 1000);
+  XUngrabKeyboard(display, CurrentTime);
+  XUngrabPointer(display, CurrentTime);
+  if (menu != None) {
+    XDestroyWindow(display, menu);
+  }
+  XSync(display, False);
+  struct timeval release;
+  gettimeofday(&release, NULL);
+
+  struct timeval locked_at;
+  if (WaitForLock(pid, lock_fd, &locked_at)) {
+    AddSample(&grab_after_release, MillisecondsBetween(&release, &locked_at));
+  } else {
+    ++*failures;
+  }
+  StopLock(pid);
+}
+
+/*! \brief Waits until the lock's background window is on top of ours again.
+ */
+static void WaitForTop(Display *display, Window background, Window adversary,
+                       const struct timeval *start) {
+  while (!IsAbove(display, background, adversary)) {
+    if (MillisecondsSince(start) > TIMEOUT_MS) {
+      fprintf(stderr, "The lock did not get back on top.\n");
+      exit(1);
+    }
+    usleep(POLL_US);
+  }
+}
+
+static void BenchRestack(Display *display, Window background,
+                         Window adversary) {
+  XRaiseWindow(display, adversary);
+  XSync(display, False);
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  WaitForTop(display, background, adversary, &start);
+  AddSample(&restack, MillisecondsSince(&start));
+}
+
+static void BenchRemap(Display *display, Window background) {
+  XUnmapWindow(display, background);
+  XSync(display, False);
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  for (;;) {
+    XWindowAttributes attrs;
+    if (XGetWindowAttributes(display, background, &attrs) &&
+        attrs.map_state == IsViewable) {
+      break;
+    }
+    if (MillisecondsSince(&start) > TIMEOUT_MS) {
+      fprintf(stderr, "The lock did not remap its window.\n");
+      exit(1);
+    }
+    usleep(POLL_US);
+  }
+  AddSample(&remap, MillisecondsSince(&start));
+}
+
+static void BenchRaiseWar(Display *display, pid_t pid, Window background,
+                          Window adversary, int seconds) {
+  struct TreeStats before, after;
+  GetTreeStats(pid, &before);
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  unsigned long checks = 0, on_top = 0;
+  while (MillisecondsSince(&start) < seconds * 1000.0) {
+    XRaiseWindow(display, adversary);
+    XFlush(display);
+    usleep(POLL_US);
+    ++checks;
+    if (IsAbove(display, background, adversary)) {
+      ++on_top;
+    }
+  }
+  GetTreeStats(pid, &after);
+  double elapsed = MillisecondsSince(&start) / 1000.0;
+  AddSample(&raise_war_cpu, (after.ticks - before.ticks) * 100.0 /
+                                sysconf(_SC_CLK_TCK) / elapsed);
+  AddSample(&raise_war_on_top, on_top * 100.0 / checks);
+}
+
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    fprintf(stderr,
+            "Usage: %s /path/to/xsecurelock repetitions raise_war_seconds\n",
+            argv[0]);
+    return 1;
+  }
+  const char *xsecurelock = argv[1];
+  int repetitions = atoi(argv[2]);
+  int raise_war_seconds = atoi(argv[3]);
+
+  Display *display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    fprintf(stderr, "Could not connect to $DISPLAY.\n");
+    return 1;
+  }
+  // Same durations every run, so results are comparable.
+  srand(1);
+
+  int failures = 0;
+  for (int i = 0; i < repetitions; ++i) {
+    BenchGrab(display, xsecurelock, i % GRAB_KIND_COUNT,
+              rand() % MAX_HOLD_MS, &failures);
+  }
+  AddSample(&grab_failures, failures);
+  fprintf(stderr, "Grab contention done.\n");
+
+  int lock_fd;
+  pid_t pid = StartLock(xsecurelock, &lock_fd);
+  if (!WaitForLock(pid, lock_fd, NULL)) {
+    fprintf(stderr, "xsecurelock did not lock.\n");
+    StopLock(pid);
+    return 1;
+  }
+  Window root = DefaultRootWindow(display);
+  Window background = FindWindow(display, root, "background");
+  if (background == None) {
+    fprintf(stderr, "Could not find the lock's background window.\n");
+    StopLock(pid);
+    return 1;
+  }
+  int screen = DefaultScreen(display);
+  Window adversary = CreateOverrideRedirectWindow(
+      display, 0, 0, DisplayWidth(display, screen) / 2,
+      DisplayHeight(display, screen) / 2);
+  XMapRaised(display, adversary);
+  XSync(display, False);
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  WaitForTop(display, background, adversary, &start);
+
+  for (int i = 0; i < repetitions; ++i) {
+    usleep((rand() % 100) * 1000);
+    BenchRestack(display, background, adversary);
+    usleep((rand() % 100) * 1000);
+    BenchRemap(display, background);
+  }
+  fprintf(stderr, "Restacking done.\n");
+
+  if (raise_war_seconds > 0) {
+    BenchRaiseWar(display, pid, background, adversary, raise_war_seconds);
+    fprintf(stderr, "Raise war done.\n");
+  }
+
+  XDestroyWindow(display, adversary);
+  XCloseDisplay(display);
+  if (!StopLock(pid)) {
+    fprintf(stderr, "xsecurelock died during the benchmark.\n");
+    return 1;
+  }
+
+  PrintSamples(&grab_after_release);
+  PrintSamples(&grab_failures);
+  PrintSamples(&restack);
+  PrintSamples(&remap);
+  PrintSamples(&raise_war_cpu);
+  PrintSamples(&raise_war_on_top);
+  return 0;
+}
@@ -0,0 +1,311 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief End-to-end lock benchmark.
+ *
+ *Repeatedly locks the screen with the real xsecurelock binary, wakes it up,
+ *types the password and unlocks again, all via the XTest extension, and
+ *reports the following metrics as JSON lines on stdout:
+ *
+ *- time_to_lock_ms: from exec until xsecurelock closes XSS_SLEEP_LOCK_FD,
+ *  which it does in NotifyOfLock.
+ *- wake_to_prompt_ms: from the first key press until the screen changes.
+ *- keystroke_echo_ms: from each password key press until the screen changes.
+ *- unlock_visible_ms: from pressing Return until the screen shows the same
+ *  as before locking.
+ *- unlock_ms: from pressing Return until xsecurelock exits.
+ *- idle_cpu_percent, idle_wakeups_per_second: CPU time and context switches
+ *  of the whole lock process tree while locked and idle for idle_seconds.
+ *- rss_kb, pss_kb: total memory of the lock process tree at the end of that.
+ *
+ *The idle metrics are measured in idle_repetitions of the repetitions, spread
+ *evenly; by default in all of them.
+ *
+ *Screen changes are detected by polling a checksum of the root window image,
+ *so the latencies include the X server's rendering, with a resolution of
+ *about one XGetImage of the screen.
+ *
+ *Usage:
+ *  bench_lock /path/to/xsecurelock repetitions idle_seconds password \
+ *    [idle_repetitions]
+ *
+ *Normally run by bench.sh, which sets up the X server and the environment.
+ */
+
+#include <X11/X.h>                  // for AllPlanes, ZPixmap
+#include <X11/Xlib.h>               // for XGetImage, XKeysymToKeycode
+#include <X11/Xutil.h>              // for XDestroyImage
+#include <X11/extensions/XTest.h>   // for XTestFakeKeyEvent
+#include <X11/keysym.h>             // for XK_Return, XK_space
+#include <poll.h>                   // for poll, pollfd, POLLIN
+#include <signal.h>                 // for kill, SIGTERM
+#include <stdint.h>                 // for uint32_t
+#include <stdio.h>                  // for printf, fprintf, snprintf, stderr
+#include <stdlib.h>                 // for exit, setenv, atoi
+#include <sys/time.h>               // for gettimeofday, timeval
+#include <sys/wait.h>               // for waitpid, WNOHANG
+#include <unistd.h>                 // for fork, execl, pipe, sysconf
+
+#include "bench_samples.h"  // for AddSample, PrintSamples, Samples
+#include "proc_tree.h"      // for GetTreeStats, TreeStats
+#include "../util.h"        // for MillisecondsSince
+
+//! How long to wait for anything to happen before giving up.
+#define TIMEOUT_MS 10000
+
+//! For how long the screen must not change to count as settled.
+#define SETTLE_MS 200
+
+static struct Samples time_to_lock = {"time_to_lock_ms", NULL, 0, 0};
+static struct Samples wake_to_prompt = {"wake_to_prompt_ms", NULL, 0, 0};
+static struct Samples keystroke_echo = {"keystroke_echo_ms", NULL, 0, 0};
+static struct Samples unlock_visible = {"unlock_visible_ms", NULL, 0, 0};
+static struct Samples unlock = {"unlock_ms", NULL, 0, 0};
+static struct Samples idle_cpu = {"idle_cpu_percent", NULL, 0, 0};
+static struct Samples idle_wakeups = {"idle_wakeups_per_second", NULL, 0, 0};
+static struct Samples rss = {"rss_kb", NULL, 0, 0};
+static struct Samples pss = {"pss_kb", NULL, 0, 0};
+
+/*! \brief Returns a checksum of what is currently on the screen.
+ */
+static uint32_t ScreenChecksum(Display *display) {
+  int screen = DefaultScreen(display);
+  XImage *image = XGetImage(display, RootWindow(display, screen), 0, 0,
+                            DisplayWidth(display, screen),
+                            DisplayHeight(display, screen), AllPlanes, ZPixmap);
+  if (image == NULL) {
+    fprintf(stderr, "XGetImage failed.\n");
+    exit(1);
+  }
+  // FNV-1a.
+  uint32_t h = 2166136261U;
+  size_t size = (size_t)image->bytes_per_line * image->height;
+  const unsigned char *p = (const unsigned char *)image->data;
+  for (size_t i = 0; i < size; ++i) {
+    h = (h ^ p[i]) * 16777619U;
+  }
+  XDestroyImage(image);
+  return h;
+}
+
+/*! \brief Waits until the screen differs from the given checksum.
+ *
+ * \return The new checksum.
+ */
+static uint32_t WaitForScreenChange(Display *display, uint32_t old,
+                                    const struct timeval *start) {
+  for (;;) {
+    uint32_t h = ScreenChecksum(display);
+    if (h != old) {
+      return h;
+    }
+    if (MillisecondsSince(start) > TIMEOUT_MS) {
+      fprintf(stderr, "Timed out waiting for the screen to change.\n");
+      exit(1);
+    }
+  }
+}
+
+/*! \brief Waits until the screen has the given checksum.
+ */
+static void WaitForScreen(Display *display, uint32_t expected,
+                          const struct timeval *start) {
+  while (ScreenChecksum(display) != expected) {
+    if (MillisecondsSince(start) > TIMEOUT_MS) {
+      fprintf(stderr, "Timed out waiting for the desktop to show.\n");
+      exit(1);
+    }
+  }
+}
+
+/*! \brief Waits until the screen stops changing.
+ *
+ * \return The final checksum.
+ */
+static uint32_t WaitForScreenSettled(Display *display) {
+  struct timeval start, stable_since;
+  gettimeofday(&start, NULL);
+  stable_since = start;
+  uint32_t h = ScreenChecksum(display);
+  while (MillisecondsSince(&stable_since) < SETTLE_MS) {
+    usleep(10000);
+    uint32_t new_h = ScreenChecksum(display);
+    if (new_h != h) {
+      h = new_h;
+      gettimeofday(&stable_since, NULL);
+    }
+    if (MillisecondsSince(&start) > TIMEOUT_MS) {
+      fprintf(stderr, "Timed out waiting for the screen to settle.\n");
+      exit(1);
+    }
+  }
+  return h;
+}
+
+static void PressKey(Display *display, KeySym keysym) {
+  KeyCode keycode = XKeysymToKeycode(display, keysym);
+  if (keycode == 0) {
+    fprintf(stderr, "No keycode for keysym %lu.\n", (unsigned long)keysym);
+    exit(1);
+  }
+  XTestFakeKeyEvent(display, keycode, True, CurrentTime);
+  XTestFakeKeyEvent(display, keycode, False, CurrentTime);
+  XFlush(display);
+}
+
+static pid_t Lock(const char *xsecurelock) {
+  int fds[2];
+  if (pipe(fds) == -1) {
+    perror("pipe");
+    exit(1);
+  }
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    exit(1);
+  } else if (pid == 0) {
+    char fd_str[16];
+    snprintf(fd_str, sizeof(fd_str), "%d", fds[1]);
+    setenv("XSS_SLEEP_LOCK_FD", fd_str, 1);
+    close(fds[0]);
+    execl(xsecurelock, xsecurelock, (char *)NULL);
+    perror("execl");
+    _exit(1);
+  }
+  close(fds[1]);
+  // xsecurelock closes the fd once locked; children don't inherit it.
+  struct pollfd pfd = {fds[0], POLLIN, 0};
+  char c;
+  if (poll(&pfd, 1, TIMEOUT_MS) != 1 || read(fds[0], &c, 1) != 0) {
+    fprintf(stderr, "xsecurelock did not lock.\n");
+    kill(pid, SIGTERM);
+    exit(1);
+  }
+  AddSample(&time_to_lock, MillisecondsSince(&start));
+  close(fds[0]);
+  return pid;
+}
+
+static void MeasureIdle(pid_t pid, int seconds) {
+  struct TreeStats before, after;
+  GetTreeStats(pid, &before);
+  sleep(seconds);
+  GetTreeStats(pid, &after);
+  AddSample(&idle_cpu, (after.ticks - before.ticks) * 100.0 /
+                           sysconf(_SC_CLK_TCK) / seconds);
+  AddSample(&idle_wakeups,
+            (double)(after.context_switches - before.context_switches) /
+                seconds);
+  AddSample(&rss, after.rss_kb);
+  AddSample(&pss, after.pss_kb);
+}
+
+static void Unlock(Display *display, pid_t pid, const char *password,
+                   uint32_t desktop) {
+  // The first key press only wakes up the auth dialog.
+  uint32_t h = WaitForScreenSettled(display);
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  PressKey(display, XK_space);
+  WaitForScreenChange(display, h, &start);
+  AddSample(&wake_to_prompt, MillisecondsSince(&start));
+
+  for (const char *p = password; *p; ++p) {
+    h = WaitForScreenSettled(display);
+    char keyname[2] = {*p, 0};
+    gettimeofday(&start, NULL);
+    PressKey(display, XStringToKeysym(keyname));
+    WaitForScreenChange(display, h, &start);
+    AddSample(&keystroke_echo, MillisecondsSince(&start));
+  }
+
+  WaitForScreenSettled(display);
+  gettimeofday(&start, NULL);
+  PressKey(display, XK_Return);
+  WaitForScreen(display, desktop, &start);
+  AddSample(&unlock_visible, MillisecondsSince(&start));
+  int status;
+  while (waitpid(pid, &status, WNOHANG) == 0) {
+    if (MillisecondsSince(&start) > TIMEOUT_MS) {
+      fprintf(stderr, "xsecurelock did not unlock.\n");
+      kill(pid, SIGTERM);
+      exit(1);
+    }
+    usleep(500);
+  }
+  AddSample(&unlock, MillisecondsSince(&start));
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "xsecurelock exited with status %d.\n", status);
+    exit(1);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc != 5 && argc != 6) {
+    fprintf(stderr,
+            "Usage: %s /path/to/xsecurelock repetitions idle_seconds "
+            "password [idle_repetitions]\n",
+            argv[0]);
+    return 1;
+  }
+  const char *xsecurelock = argv[1];
+  int repetitions = atoi(argv[2]);
+  int idle_seconds = atoi(argv[3]);
+  const char *password = argv[4];
+  int idle_repetitions = argc == 6 ? atoi(argv[5]) : repetitions;
+  if (idle_seconds <= 0 || idle_repetitions < 0) {
+    idle_repetitions = 0;
+  } else if (idle_repetitions > repetitions) {
+    idle_repetitions = repetitions;
+  }
+
+  Display *display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    fprintf(stderr, "Could not connect to $DISPLAY.\n");
+    return 1;
+  }
+  int event_base, error_base, major, minor;
+  if (!XTestQueryExtension(display, &event_base, &error_base, &major,
+                           &minor)) {
+    fprintf(stderr, "The X server does not support XTest.\n");
+    return 1;
+  }
+
+  for (int i = 0; i < repetitions; ++i) {
+    uint32_t desktop = WaitForScreenSettled(display);
+    pid_t pid = Lock(xsecurelock);
+    // Spreads the idle measurements evenly over all repetitions.
+    if ((long)i * idle_repetitions % repetitions < idle_repetitions) {
+      MeasureIdle(pid, idle_seconds);
+    }
+    Unlock(display, pid, password, desktop);
+    fprintf(stderr, "Repetition %d done.\n", i + 1);
+  }
+
+  PrintSamples(&time_to_lock);
+  PrintSamples(&wake_to_prompt);
+  PrintSamples(&keystroke_echo);
+  PrintSamples(&unlock_visible);
+  PrintSamples(&unlock);
+  PrintSamples(&idle_cpu);
+  PrintSamples(&idle_wakeups);
+  PrintSamples(&rss);
+  PrintSamples(&pss);
+  return 0;
+}
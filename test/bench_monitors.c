@@ -0,0 +1,321 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief Monitor query benchmark.
+ *
+ *Times GetMonitors() on the XRandR 1.5, XRandR 1.2 and guess code paths for
+ *whatever monitor layout the X server currently has, and optionally how long
+ *saver_multiplex takes to respawn its savers after a layout change.
+ *
+ *Monitors added with xrandr --setmonitor only exist for XRandR 1.5; they add
+ *no CRTCs or outputs. So if there are any, the XRandR 1.2 and guess paths
+ *would just time the server's real outputs again, and are skipped.
+ *
+ *Usage:
+ *  bench_monitors iterations [/path/to/saver_multiplex /path/to/saver]
+ *
+ *Normally run by bench-monitors.sh, which sets up the layouts.
+ */
+
+#include <X11/X.h>       // for Window, None
+#include <X11/Xlib.h>    // for XOpenDisplay, XNextEvent, XCreateWindow
+#include <signal.h>      // for kill, SIGTERM
+#include <stdio.h>       // for printf, fprintf, snprintf, stderr
+#include <stdlib.h>      // for setenv, atoi, exit
+#include <sys/select.h>  // for select, FD_SET, FD_ZERO, fd_set
+#include <sys/time.h>    // for gettimeofday, timeval
+#include <sys/wait.h>    // for waitpid
+#include <unistd.h>      // for fork, execl, _exit
+
+#ifdef HAVE_XRANDR_EXT
+#include <X11/extensions/Xrandr.h>  // for XRRGetMonitors, XRRSetMonitor
+#include <X11/extensions/randr.h>   // for RANDR_MAJOR, RANDR_MINOR
+#if RANDR_MAJOR > 1 || (RANDR_MAJOR == 1 && RANDR_MINOR >= 5)
+#define HAVE_XRANDR15_EXT
+#endif
+#endif
+
+#include "../helpers/monitors.h"  // for GetMonitors, Monitor, SelectMonito...
+#include "../saver_child.h"       // for MAX_SAVERS
+#include "../util.h"              // for MillisecondsSince
+
+//! More than the 64 monitors bench-monitors.sh creates at most.
+#define MAX_BENCH_MONITORS 128
+
+//! How long to wait for saver_multiplex to map its windows.
+#define RESPAWN_TIMEOUT_MS 10000
+
+static void BenchPath(const char *path, const char *no_xrandr,
+                      const char *no_xrandr15, int iterations) {
+  setenv("XSECURELOCK_NO_XRANDR", no_xrandr, 1);
+  setenv("XSECURELOCK_NO_XRANDR15", no_xrandr15, 1);
+
+  // monitors.c reads its settings again for every new connection. The
+  // connection is deliberately never closed, as monitors.c identifies it by
+  // pointer, which a new connection could otherwise reuse.
+  Display *display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    fprintf(stderr, "Could not connect to $DISPLAY.\n");
+    exit(1);
+  }
+  Window root = DefaultRootWindow(display);
+  Monitor monitors[MAX_BENCH_MONITORS];
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  size_t num_monitors =
+      GetMonitors(display, root, monitors, MAX_BENCH_MONITORS);
+  double cold_ms = MillisecondsSince(&start);
+
+  // Without SelectMonitorChangeEvents, every call queries the X server.
+  gettimeofday(&start, NULL);
+  for (int i = 0; i < iterations; ++i) {
+    GetMonitors(display, root, monitors, MAX_BENCH_MONITORS);
+  }
+  double uncached_ms = MillisecondsSince(&start) / iterations;
+
+  // With it, only the first call does.
+  SelectMonitorChangeEvents(display, root);
+  GetMonitors(display, root, monitors, MAX_BENCH_MONITORS);
+  gettimeofday(&start, NULL);
+  for (int i = 0; i < iterations; ++i) {
+    GetMonitors(display, root, monitors, MAX_BENCH_MONITORS);
+  }
+  double cached_ms = MillisecondsSince(&start) / iterations;
+
+  printf("path=%s found=%d cold_ms=%.3f uncached_ms=%.3f cached_ms=%.3f\n",
+         path, (int)num_monitors, cold_ms, uncached_ms, cached_ms);
+}
+
+/*! \brief Checks whether there are monitors only XRandR 1.5 knows about.
+ */
+static int HaveSyntheticMonitors(void) {
+  int found = 0;
+#ifdef HAVE_XRANDR15_EXT
+  Display *display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    fprintf(stderr, "Could not connect to $DISPLAY.\n");
+    exit(1);
+  }
+  int num_rrmonitors;
+  XRRMonitorInfo *rrmonitors = XRRGetMonitors(
+      display, DefaultRootWindow(display), True, &num_rrmonitors);
+  if (rrmonitors != NULL) {
+    for (int i = 0; i < num_rrmonitors; ++i) {
+      if (!rrmonitors[i].automatic) {
+        found = 1;
+      }
+    }
+    XRRFreeMonitors(rrmonitors);
+  }
+  XCloseDisplay(display);
+#endif
+  return found;
+}
+
+#ifdef HAVE_XRANDR15_EXT
+/*! \brief Waits until the given number of children of parent got mapped.
+ *
+ * \return The time waited in milliseconds, or -1 on timeout.
+ */
+static double WaitForMaps(Display *display, Window parent, int expected) {
+  int x11_fd = ConnectionNumber(display);
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  int mapped = 0;
+  while (mapped < expected) {
+    double elapsed_ms = MillisecondsSince(&start);
+    if (elapsed_ms >= RESPAWN_TIMEOUT_MS) {
+      return -1;
+    }
+    if (!XPending(display)) {
+      int timeout_ms = RESPAWN_TIMEOUT_MS - (int)elapsed_ms;
+      fd_set in_fds;
+      FD_ZERO(&in_fds);
+      FD_SET(x11_fd, &in_fds);
+      struct timeval tv;
+      tv.tv_sec = timeout_ms / 1000;
+      tv.tv_usec = (timeout_ms % 1000) * 1000;
+      select(x11_fd + 1, &in_fds, 0, 0, &tv);
+      continue;
+    }
+    XEvent ev;
+    XNextEvent(display, &ev);
+    if (ev.type == MapNotify && ev.xmap.event == parent) {
+      ++mapped;
+    }
+  }
+  return MillisecondsSince(&start);
+}
+
+/*! \brief Resizes the first user defined monitor by one pixel.
+ *
+ * As the first monitor XRandR reports always is used, this always changes
+ * the layout saver_multiplex sees.
+ *
+ * \return Whether there was a monitor to resize.
+ */
+static int ToggleMonitorSize(Display *display, Window root, int shrink) {
+  int num_rrmonitors;
+  XRRMonitorInfo *rrmonitors =
+      XRRGetMonitors(display, root, True, &num_rrmonitors);
+  if (rrmonitors == NULL) {
+    return 0;
+  }
+  int found = 0;
+  for (int i = 0; i < num_rrmonitors; ++i) {
+    if (rrmonitors[i].automatic) {
+      continue;
+    }
+    XRRMonitorInfo *monitor =
+        XRRAllocateMonitor(display, rrmonitors[i].noutput);
+    monitor->name = rrmonitors[i].name;
+    monitor->primary = rrmonitors[i].primary;
+    monitor->x = rrmonitors[i].x;
+    monitor->y = rrmonitors[i].y;
+    monitor->width = rrmonitors[i].width + (shrink ? -1 : 1);
+    monitor->height = rrmonitors[i].height;
+    monitor->mwidth = rrmonitors[i].mwidth;
+    monitor->mheight = rrmonitors[i].mheight;
+    for (int j = 0; j < rrmonitors[i].noutput; ++j) {
+      monitor->outputs[j] = rrmonitors[i].outputs[j];
+    }
+    XRRSetMonitor(display, root, monitor);
+    XRRFreeMonitors(monitor);
+    found = 1;
+    break;
+  }
+  XRRFreeMonitors(rrmonitors);
+  return found;
+}
+
+static void BenchRespawn(const char *saver_multiplex, const char *saver,
+                         int iterations) {
+  unsetenv("XSECURELOCK_NO_XRANDR");
+  unsetenv("XSECURELOCK_NO_XRANDR15");
+
+  Display *display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    fprintf(stderr, "Could not connect to $DISPLAY.\n");
+    exit(1);
+  }
+  Window root = DefaultRootWindow(display);
+  XSetWindowAttributes attrs = {0};
+  attrs.override_redirect = True;
+  attrs.event_mask = SubstructureNotifyMask;
+  Window parent = XCreateWindow(
+      display, root, 0, 0, DisplayWidth(display, DefaultScreen(display)),
+      DisplayHeight(display, DefaultScreen(display)), 0, CopyFromParent,
+      InputOutput, CopyFromParent, CWOverrideRedirect | CWEventMask, &attrs);
+  XMapRaised(display, parent);
+  XFlush(display);
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    char window_id[32];
+    snprintf(window_id, sizeof(window_id), "%lu", (unsigned long)parent);
+    setenv("XSCREENSAVER_WINDOW", window_id, 1);
+    setenv("XSECURELOCK_SAVER", saver, 1);
+    // Measure the respawn itself, not the wait for more changes.
+    setenv("XSECURELOCK_MONITOR_SETTLE_MS", "0", 1);
+    execl(saver_multiplex, saver_multiplex, NULL);
+    perror("execl");
+    _exit(1);
+  }
+
+  Monitor monitors[MAX_BENCH_MONITORS];
+  int expected = GetMonitors(display, parent, monitors, MAX_BENCH_MONITORS);
+  if (expected > MAX_SAVERS) {
+    expected = MAX_SAVERS;
+  }
+  double startup_ms = WaitForMaps(display, parent, expected);
+
+  double total_ms = 0, max_ms = 0;
+  int done = 0;
+  for (int i = 0; startup_ms >= 0 && i < iterations; ++i) {
+    if (!ToggleMonitorSize(display, root, i % 2 == 0)) {
+      break;
+    }
+    XSync(display, False);
+    expected = GetMonitors(display, parent, monitors, MAX_BENCH_MONITORS);
+    if (expected > MAX_SAVERS) {
+      expected = MAX_SAVERS;
+    }
+    double ms = WaitForMaps(display, parent, expected);
+    if (ms < 0) {
+      break;
+    }
+    total_ms += ms;
+    if (ms > max_ms) {
+      max_ms = ms;
+    }
+    ++done;
+  }
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  XDestroyWindow(display, parent);
+  XCloseDisplay(display);
+
+  if (done == 0) {
+    printf("path=respawn failed=1 startup_ms=%.3f\n", startup_ms);
+    return;
+  }
+  printf("path=respawn savers=%d startup_ms=%.3f respawn_ms=%.3f max_ms=%.3f\n",
+         expected, startup_ms, total_ms / done, max_ms);
+}
+#endif
+
+int main(int argc, char **argv) {
+  if (argc != 2 && argc != 4) {
+    fprintf(stderr,
+            "Usage: %s iterations [/path/to/saver_multiplex /path/to/saver]\n",
+            argv[0]);
+    return 1;
+  }
+  int iterations = atoi(argv[1]);
+  if (iterations < 1) {
+    iterations = 1;
+  }
+
+  // Before any GetMonitors call, as monitors.c identifies connections by
+  // pointer, and this one gets closed.
+  int synthetic = HaveSyntheticMonitors();
+
+  BenchPath("xrandr15", "0", "0", iterations);
+  if (synthetic) {
+    printf("path=xrandr12 skipped=synthetic_monitors\n");
+    printf("path=guess skipped=synthetic_monitors\n");
+  } else {
+    BenchPath("xrandr12", "0", "1", iterations);
+    BenchPath("guess", "1", "1", iterations);
+  }
+
+  if (argc == 4) {
+#ifdef HAVE_XRANDR15_EXT
+    BenchRespawn(argv[2], argv[3], iterations);
+#else
+    fprintf(stderr, "Respawn benchmark requires XRandR 1.5.\n");
+#endif
+  }
+
+  return 0;
+}
@@ -0,0 +1,55 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "bench_samples.h"
+
+#include <stdio.h>   // for printf, fprintf, stderr
+#include <stdlib.h>  // for exit, qsort, realloc
+
+void AddSample(struct Samples *s, double value) {
+  if (s->n == s->cap) {
+    s->cap = s->cap ? 2 * s->cap : 16;
+    s->values = realloc(s->values, s->cap * sizeof(*s->values));
+    if (s->values == NULL) {
+      fprintf(stderr, "Out of memory.\n");
+      exit(1);
+    }
+  }
+  s->values[s->n++] = value;
+}
+
+static int CompareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double Percentile(const struct Samples *s, int percent) {
+  // Nearest rank.
+  size_t rank = (s->n * percent + 99) / 100;
+  return s->values[rank > 0 ? rank - 1 : 0];
+}
+
+void PrintSamples(struct Samples *s) {
+  if (s->n == 0) {
+    return;
+  }
+  qsort(s->values, s->n, sizeof(*s->values), CompareDoubles);
+  printf(
+      "{\"metric\":\"%s\",\"n\":%lu,\"min\":%.3f,\"p50\":%.3f,\"p90\":%.3f,"
+      "\"p99\":%.3f,\"max\":%.3f}\n",
+      s->name, (unsigned long)s->n, s->values[0], Percentile(s, 50),
+      Percentile(s, 90), Percentile(s, 99), s->values[s->n - 1]);
+}
@@ -0,0 +1,39 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef BENCH_SAMPLES_H
+#define BENCH_SAMPLES_H
+
+#include <stddef.h>  // for size_t
+
+//! A series of measurements of one metric.
+struct Samples {
+  const char *name;
+  double *values;
+  size_t n, cap;
+};
+
+/*! \brief Records one measurement. Exits if out of memory.
+ */
+void AddSample(struct Samples *s, double value);
+
+/*! \brief Prints a JSON line with the distribution of the measurements.
+ *
+ * Prints nothing if there were none. Sorts the values.
+ */
+void PrintSamples(struct Samples *s);
+
+#endif
@@ -0,0 +1,71 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "lock_windows.h"
+
+#include <string.h>  // for strcmp
+
+static int HasName(Display *display, Window w, const char *name) {
+  char *window_name;
+  if (!XFetchName(display, w, &window_name) || window_name == NULL) {
+    return 0;
+  }
+  int result = !strcmp(window_name, name);
+  XFree(window_name);
+  return result;
+}
+
+Window FindWindow(Display *display, Window w, const char *name) {
+  if (HasName(display, w, name)) {
+    return w;
+  }
+  Window root, parent, *children;
+  unsigned int n;
+  if (!XQueryTree(display, w, &root, &parent, &children, &n)) {
+    return None;
+  }
+  Window found = None;
+  for (unsigned int i = 0; i < n && found == None; ++i) {
+    found = FindWindow(display, children[i], name);
+  }
+  if (children != NULL) {
+    XFree(children);
+  }
+  return found;
+}
+
+int IsAbove(Display *display, Window a, Window b) {
+  Window root, parent, *children;
+  unsigned int n;
+  if (!XQueryTree(display, DefaultRootWindow(display), &root, &parent,
+                  &children, &n)) {
+    return 0;
+  }
+  // Children are listed bottom to top.
+  int pos_a = -1, pos_b = -1;
+  for (unsigned int i = 0; i < n; ++i) {
+    if (children[i] == a) {
+      pos_a = i;
+    }
+    if (children[i] == b) {
+      pos_b = i;
+    }
+  }
+  if (children != NULL) {
+    XFree(children);
+  }
+  return pos_a > pos_b;
+}
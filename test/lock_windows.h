@@ -0,0 +1,35 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef LOCK_WINDOWS_H
+#define LOCK_WINDOWS_H
+
+#include <X11/X.h>     // for Window
+#include <X11/Xlib.h>  // for Display
+
+/*! \brief Finds a window by name, depth first.
+ *
+ * xsecurelock names its windows, e.g. "background" and "saver".
+ *
+ * \return The window, or None if not found.
+ */
+Window FindWindow(Display *display, Window w, const char *name);
+
+/*! \brief Returns whether a is stacked above b among the root's children.
+ */
+int IsAbove(Display *display, Window a, Window b);
+
+#endif
@@ -0,0 +1,134 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "proc_tree.h"
+
+#include <ctype.h>   // for isdigit
+#include <dirent.h>  // for opendir, readdir, closedir
+#include <stdio.h>   // for snprintf, fopen, fgets, sscanf, perror
+#include <stdlib.h>  // for atoi, exit, strtoull
+#include <string.h>  // for memset, strlen, strncmp, strrchr
+
+//! The most processes of the tree we look at.
+#define MAX_TREE 256
+
+//! The most processes on the system we look at.
+#define MAX_PROCESSES 4096
+
+static int ReadPpid(pid_t pid, pid_t *ppid, unsigned long long *ticks) {
+  char path[64], buf[1024];
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  int ok = fgets(buf, sizeof(buf), f) != NULL;
+  fclose(f);
+  // The command name may contain anything, so parse after its closing paren.
+  char *p = ok ? strrchr(buf, ')') : NULL;
+  char state;
+  int parent;
+  unsigned long utime, stime;
+  if (p == NULL || sscanf(p + 1,
+                          " %c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                          &state, &parent, &utime, &stime) != 4) {
+    return -1;
+  }
+  *ppid = parent;
+  *ticks = (unsigned long long)utime + stime;
+  return 0;
+}
+
+static unsigned long long ReadField(const char *path, const char *field) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    return 0;
+  }
+  unsigned long long value = 0;
+  size_t len = strlen(field);
+  char buf[256];
+  while (fgets(buf, sizeof(buf), f) != NULL) {
+    if (!strncmp(buf, field, len)) {
+      value = strtoull(buf + len, NULL, 10);
+      break;
+    }
+  }
+  fclose(f);
+  return value;
+}
+
+void GetTreeStats(pid_t root, struct TreeStats *stats) {
+  pid_t pids[MAX_TREE];
+  unsigned long long ticks[MAX_TREE];
+  size_t n = 0;
+  DIR *dir = opendir("/proc");
+  if (dir == NULL) {
+    perror("opendir /proc");
+    exit(1);
+  }
+  struct dirent *de;
+  // Collect all processes, then keep those descending from root.
+  static pid_t all[MAX_PROCESSES], all_ppid[MAX_PROCESSES];
+  static unsigned long long all_ticks[MAX_PROCESSES];
+  size_t num_all = 0;
+  while ((de = readdir(dir)) != NULL && num_all < MAX_PROCESSES) {
+    if (!isdigit((unsigned char)de->d_name[0])) {
+      continue;
+    }
+    pid_t pid = atoi(de->d_name);
+    if (ReadPpid(pid, &all_ppid[num_all], &all_ticks[num_all]) == 0) {
+      all[num_all++] = pid;
+    }
+  }
+  closedir(dir);
+  for (size_t i = 0; i < num_all; ++i) {
+    if (all[i] == root) {
+      pids[0] = root;
+      ticks[0] = all_ticks[i];
+      n = 1;
+    }
+  }
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (size_t i = 0; i < num_all && n < MAX_TREE; ++i) {
+      int in_tree = 0, parent_in_tree = 0;
+      for (size_t j = 0; j < n; ++j) {
+        in_tree |= pids[j] == all[i];
+        parent_in_tree |= pids[j] == all_ppid[i];
+      }
+      if (!in_tree && parent_in_tree) {
+        pids[n] = all[i];
+        ticks[n] = all_ticks[i];
+        ++n;
+        changed = 1;
+      }
+    }
+  }
+  memset(stats, 0, sizeof(*stats));
+  for (size_t i = 0; i < n; ++i) {
+    char path[64];
+    stats->ticks += ticks[i];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pids[i]);
+    stats->context_switches += ReadField(path, "voluntary_ctxt_switches:") +
+                               ReadField(path, "nonvoluntary_ctxt_switches:");
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pids[i]);
+    stats->write_syscalls += ReadField(path, "syscw:");
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", (int)pids[i]);
+    stats->rss_kb += ReadField(path, "Rss:");
+    stats->pss_kb += ReadField(path, "Pss:");
+  }
+}
+
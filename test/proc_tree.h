@@ -0,0 +1,43 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef PROC_TREE_H
+#define PROC_TREE_H
+
+#include <sys/types.h>  // for pid_t
+
+//! Resource usage of a process tree, summed over all its processes.
+struct TreeStats {
+  //! User and system CPU time in clock ticks.
+  unsigned long long ticks;
+  //! Voluntary and involuntary context switches.
+  unsigned long long context_switches;
+  //! Write syscalls; for X11 clients, mostly flushes of the request buffer.
+  unsigned long long write_syscalls;
+  //! Memory use.
+  unsigned long long rss_kb, pss_kb;
+};
+
+/*! \brief Sums up resource usage of a process and all its descendants.
+ *
+ * Reads /proc, so this only works on Linux.
+ *
+ * \param root The process whose tree to look at.
+ * \param stats Receives the sums.
+ */
+void GetTreeStats(pid_t root, struct TreeStats *stats);
+
+#endif
@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# Copyright 2018 Google Inc. All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Stress tests a lock with monitor hotplug, motion and raise storms.
+#
+# Usage: ./stress-lock.sh [seconds]
+#
+# Normally run via "make stress". Like bench.sh, this uses the installed
+# binaries. Needs Xvfb (or set XSERVER, e.g. to Xephyr) and htpasswd.
+#
+# The limits can be tuned with MAX_CPU_PERCENT, MAX_RESPAWNS and
+# MAX_WRITES_PER_SECOND.
+
+set -e
+
+seconds=${1:-20}
+builddir=${BUILDDIR:-.}
+bindir=${BINDIR:-/usr/local/bin}
+display=${STRESS_DISPLAY:-:45}
+
+if ! [ -x "$builddir"/stress_lock ]; then
+  echo >&2 "stress_lock not found; it needs the XTest library to build."
+  exit 1
+fi
+
+# An isolated homedir with a fixed password.
+homedir=$(mktemp -d -t xsecurelock-stress.XXXXXX)
+htpasswd -bc "$homedir/.xsecurelock.pw" "$USER" hunter2 2>/dev/null
+
+"${XSERVER:-Xvfb}" "$display" -nolisten tcp -screen 0 1280x720x24 \
+  > /dev/null 2>&1 & xserver=$!
+trap 'kill "$xserver"; rm -rf "$homedir"' EXIT
+export DISPLAY="$display"
+for i in $(seq 50); do
+  [ -e /tmp/.X11-unix/X"${display#:}" ] && break
+  sleep 0.1
+done
+
+# Lock the screen - and wait for the lock to succeed.
+mkfifo "$homedir"/lock.notify
+HOME="$homedir" \
+XSECURELOCK_AUTH=auth_x11 \
+XSECURELOCK_AUTHPROTO=authproto_htpasswd \
+XSECURELOCK_SAVER=saver_blank \
+XSECURELOCK_NO_COMPOSITE=1 \
+  "$bindir"/xsecurelock -- cat "$homedir"/lock.notify \
+  2> stress-lock.log & pid=$!
+: > "$homedir"/lock.notify
+
+set +e
+"$builddir"/stress_lock "$pid" "$seconds" \
+  "${MAX_CPU_PERCENT:-50}" "${MAX_RESPAWNS:-10}" \
+  "${MAX_WRITES_PER_SECOND:-1000}"
+result=$?
+set -e
+
+kill "$pid" || true
+echo "Stress test status: $result."
+exit "$result"
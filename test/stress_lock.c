@@ -0,0 +1,268 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*!
+ *\brief Lock stress test.
+ *
+ *Acts as a hostile companion client to a running, locked xsecurelock: it
+ *hotplugs a synthetic XRandR monitor over and over (like a flaky KVM switch
+ *or dock) and keeps raising an override-redirect window. In the first half,
+ *this hits the per-monitor savers; in the second half, it also floods the
+ *server with pointer motion, which brings up auth_x11 and keeps it up.
+ *Meanwhile it checks that:
+ *
+ *- the lock keeps its keyboard and pointer grabs,
+ *- the lock's background window gets back on top of the raised window,
+ *- the per-monitor savers get respawned at most max_respawns times,
+ *- the lock process tree stays below max_cpu_percent CPU and
+ *  max_writes_per_second write syscalls, which approximates how often it
+ *  flushes X requests.
+ *
+ *Usage:
+ *  stress_lock xsecurelock_pid seconds max_cpu_percent max_respawns \
+ *    max_writes_per_second
+ *
+ *Normally run by stress-lock.sh. Exits with status 1 if any check failed.
+ */
+
+#include <X11/X.h>                 // for Window, None, GrabSuccess
+#include <X11/Xlib.h>              // for XGrabKeyboard, XInternAtom
+#include <X11/extensions/XTest.h>  // for XTestFakeMotionEvent
+#include <signal.h>                // for kill
+#include <stdio.h>                 // for printf, fprintf, stderr
+#include <stdlib.h>                // for atoi, atof
+#include <sys/time.h>              // for gettimeofday, timeval
+#include <unistd.h>                // for usleep, sysconf
+
+#ifdef HAVE_XRANDR_EXT
+#include <X11/extensions/Xrandr.h>  // for XRRSetMonitor, XRRDeleteMonitor
+#include <X11/extensions/randr.h>   // for RANDR_MAJOR, RANDR_MINOR
+#if RANDR_MAJOR > 1 || (RANDR_MAJOR == 1 && RANDR_MINOR >= 5)
+#define HAVE_XRANDR15_EXT
+#endif
+#endif
+
+#include "lock_windows.h"  // for FindWindow, IsAbove
+#include "proc_tree.h"     // for GetTreeStats, TreeStats
+#include "../util.h"       // for MillisecondsSince
+
+//! Length of one iteration of the storm.
+#define TICK_US 10000
+
+//! Every this many ticks, the storm pauses and the stacking is checked.
+#define CHECK_TICKS 50
+
+//! How many ticks the storm pauses before checking the stacking.
+#define GRACE_TICKS 10
+
+//! Every this many ticks, the synthetic monitor is added or removed.
+#define HOTPLUG_TICKS 5
+
+//! Motion events per tick.
+#define MOTIONS_PER_TICK 20
+
+//! Raises of the storm window per tick.
+#define RAISES_PER_TICK 5
+
+/*! \brief Returns whether both grabs are still held by someone else.
+ */
+static int GrabsHeld(Display *display) {
+  Window root = DefaultRootWindow(display);
+  int held = 1;
+  if (XGrabKeyboard(display, root, False, GrabModeAsync, GrabModeAsync,
+                    CurrentTime) == GrabSuccess) {
+    XUngrabKeyboard(display, CurrentTime);
+    held = 0;
+  }
+  if (XGrabPointer(display, root, False, PointerMotionMask, GrabModeAsync,
+                   GrabModeAsync, None, None, CurrentTime) == GrabSuccess) {
+    XUngrabPointer(display, CurrentTime);
+    held = 0;
+  }
+  return held;
+}
+
+#ifdef HAVE_XRANDR15_EXT
+/*! \brief Adds or removes a synthetic monitor on the left half of the screen.
+ */
+static void Hotplug(Display *display, int add) {
+  Window root = DefaultRootWindow(display);
+  Atom name = XInternAtom(display, "stress", False);
+  if (!add) {
+    XRRDeleteMonitor(display, root, name);
+    return;
+  }
+  XRRMonitorInfo *monitor = XRRAllocateMonitor(display, 0);
+  if (monitor == NULL) {
+    return;
+  }
+  int screen = DefaultScreen(display);
+  monitor->name = name;
+  monitor->x = 0;
+  monitor->y = 0;
+  monitor->width = DisplayWidth(display, screen) / 2;
+  monitor->height = DisplayHeight(display, screen);
+  monitor->mwidth = DisplayWidthMM(display, screen) / 2;
+  monitor->mheight = DisplayHeightMM(display, screen);
+  XRRSetMonitor(display, root, monitor);
+  XRRFreeMonitors(monitor);
+}
+#endif
+
+int main(int argc, char **argv) {
+  if (argc != 6) {
+    fprintf(stderr,
+            "Usage: %s xsecurelock_pid seconds max_cpu_percent max_respawns "
+            "max_writes_per_second\n",
+            argv[0]);
+    return 1;
+  }
+  pid_t pid = atoi(argv[1]);
+  int seconds = atoi(argv[2]);
+  double max_cpu_percent = atof(argv[3]);
+  int max_respawns = atoi(argv[4]);
+  double max_writes_per_second = atof(argv[5]);
+
+  Display *display = XOpenDisplay(NULL);
+  if (display == NULL) {
+    fprintf(stderr, "Could not connect to $DISPLAY.\n");
+    return 1;
+  }
+  int event_base, error_base, major, minor;
+  if (!XTestQueryExtension(display, &event_base, &error_base, &major,
+                           &minor)) {
+    fprintf(stderr, "The X server does not support XTest.\n");
+    return 1;
+  }
+  int screen = DefaultScreen(display);
+  Window root = RootWindow(display, screen);
+  int width = DisplayWidth(display, screen);
+  int height = DisplayHeight(display, screen);
+
+  Window background = FindWindow(display, root, "background");
+  Window saver = FindWindow(display, root, "saver");
+  if (background == None || saver == None) {
+    fprintf(stderr, "Could not find the lock's windows.\n");
+    return 1;
+  }
+  // Every respawn of the per-monitor savers creates new windows inside the
+  // saver window.
+  XSelectInput(display, saver, SubstructureNotifyMask);
+
+  XSetWindowAttributes attrs = {0};
+  attrs.override_redirect = True;
+  attrs.background_pixel = WhitePixel(display, screen);
+  Window storm = XCreateWindow(display, root, 0, 0, width / 4, height / 4, 0,
+                               CopyFromParent, InputOutput, CopyFromParent,
+                               CWOverrideRedirect | CWBackPixel, &attrs);
+  XMapRaised(display, storm);
+
+#ifndef HAVE_XRANDR15_EXT
+  fprintf(stderr, "No XRandR 1.5; not testing monitor hotplug.\n");
+#endif
+
+  struct TreeStats before, after;
+  GetTreeStats(pid, &before);
+  struct timeval start;
+  gettimeofday(&start, NULL);
+
+  int failed = 0;
+  int grab_failures = 0, stacking_failures = 0, checks = 0;
+  int respawns = 0, hotplugs = 0;
+  for (int tick = 0; MillisecondsSince(&start) < seconds * 1000.0; ++tick) {
+    int phase = tick % CHECK_TICKS;
+    if (phase < CHECK_TICKS - GRACE_TICKS) {
+#ifdef HAVE_XRANDR15_EXT
+      if (tick % HOTPLUG_TICKS == 0) {
+        Hotplug(display, hotplugs++ % 2 == 0);
+      }
+#endif
+      if (MillisecondsSince(&start) > seconds * 500.0) {
+        for (int i = 0; i < MOTIONS_PER_TICK; ++i) {
+          XTestFakeMotionEvent(display, screen, (tick * 7 + i * 13) % width,
+                               (tick * 11 + i * 17) % height, CurrentTime);
+        }
+      }
+      for (int i = 0; i < RAISES_PER_TICK; ++i) {
+        XRaiseWindow(display, storm);
+      }
+    } else if (phase == CHECK_TICKS - 1) {
+      ++checks;
+      if (!GrabsHeld(display)) {
+        ++grab_failures;
+      }
+      if (!IsAbove(display, background, storm)) {
+        ++stacking_failures;
+      }
+    }
+    XFlush(display);
+    while (XPending(display)) {
+      XEvent ev;
+      XNextEvent(display, &ev);
+      if (ev.type == CreateNotify && ev.xcreatewindow.parent == saver) {
+        ++respawns;
+      }
+    }
+    if (kill(pid, 0) != 0) {
+      fprintf(stderr, "FAIL: the lock died.\n");
+      return 1;
+    }
+    usleep(TICK_US);
+  }
+
+  GetTreeStats(pid, &after);
+  double elapsed = MillisecondsSince(&start) / 1000.0;
+  double cpu_percent =
+      (after.ticks - before.ticks) * 100.0 / sysconf(_SC_CLK_TCK) / elapsed;
+  double writes_per_second =
+      (after.write_syscalls - before.write_syscalls) / elapsed;
+#ifdef HAVE_XRANDR15_EXT
+  if (hotplugs % 2 == 1) {
+    Hotplug(display, 0);
+  }
+#endif
+  XDestroyWindow(display, storm);
+  XCloseDisplay(display);
+
+  printf("checks=%d grab_failures=%d stacking_failures=%d hotplugs=%d "
+         "respawns=%d cpu_percent=%.1f writes_per_second=%.1f\n",
+         checks, grab_failures, stacking_failures, hotplugs, respawns,
+         cpu_percent, writes_per_second);
+  if (grab_failures > 0) {
+    fprintf(stderr, "FAIL: the lock lost its grabs.\n");
+    failed = 1;
+  }
+  if (stacking_failures > 0) {
+    fprintf(stderr, "FAIL: the lock did not stay on top.\n");
+    failed = 1;
+  }
+  if (respawns > max_respawns) {
+    fprintf(stderr, "FAIL: %d saver respawns, expected at most %d.\n",
+            respawns, max_respawns);
+    failed = 1;
+  }
+  if (cpu_percent > max_cpu_percent) {
+    fprintf(stderr, "FAIL: %.1f%% CPU, expected at most %.1f%%.\n",
+            cpu_percent, max_cpu_percent);
+    failed = 1;
+  }
+  if (writes_per_second > max_writes_per_second) {
+    fprintf(stderr, "FAIL: %.1f writes per second, expected at most %.1f.\n",
+            writes_per_second, max_writes_per_second);
+    failed = 1;
+  }
+  return failed;
+}
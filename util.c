@@ -34,6 +34,11 @@
  *****************************************************************************
  */
 
+#include "util.h"
+
+#include <stddef.h>    // for NULL
+#include <sys/time.h>  // for gettimeofday, timeval
+
 #ifndef HAVE_EXPLICIT_BZERO
 #include <string.h>
 
@@ -42,3 +47,22 @@ void explicit_bzero(void *s, size_t len) {
   asm volatile("" ::: "memory");
 }
 #endif
+
+double MillisecondsBetween(const struct timeval *from,
+                           const struct timeval *to) {
+  return (to->tv_sec - from->tv_sec) * 1000.0 +
+         (to->tv_usec - from->tv_usec) / 1000.0;
+}
+
+double MillisecondsSince(const struct timeval *since) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return MillisecondsBetween(since, &now);
+}
+
+long long MicrosecondsSince(const struct timeval *since) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - since->tv_sec) * 1000000LL +
+         (now.tv_usec - since->tv_usec);
+}
@@ -14,9 +14,20 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <stdlib.h>  // for size_t
+#include <stdlib.h>    // for size_t
+#include <sys/time.h>  // for timeval
 
 // Declare it - we'll either use ours or whatever autoconf found.
 // Including <bsd/string.h> would maybe be nicer, but it doesn't seem to
 // actually define this symbol unless we set _GNU_SOURCE.
 void explicit_bzero(void *s, size_t len);
+
+// Returns the milliseconds from one gettimeofday time to another.
+double MillisecondsBetween(const struct timeval *from,
+                           const struct timeval *to);
+
+// Returns the milliseconds elapsed since the given gettimeofday time.
+double MillisecondsSince(const struct timeval *since);
+
+// Returns the whole microseconds elapsed since the given gettimeofday time.
+long long MicrosecondsSince(const struct timeval *since);
@@ -0,0 +1,89 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "xserver_watchdog.h"
+
+#include <X11/Xlib.h>  // for XSync
+#include <stdio.h>     // for snprintf
+#include <string.h>    // for memset
+#include <sys/time.h>  // for gettimeofday, timeval
+
+#include "env_settings.h"  // for GetIntSetting
+#include "logging.h"       // for Log
+#include "util.h"          // for MillisecondsSince
+
+//! Number of histogram buckets: <1ms, <2ms, <4ms, ..., <512ms, >=512ms.
+#define NUM_BUCKETS 11
+
+static int interval_ms;
+static int threshold_ms;
+static struct timeval last_ping;
+static unsigned long histogram[NUM_BUCKETS];
+//! Number of consecutive round trips above the threshold.
+static int slow_streak;
+
+void InitXServerWatchdog(void) {
+  interval_ms = GetIntSetting("XSECURELOCK_WATCHDOG_INTERVAL_MS", 1000);
+  threshold_ms = GetIntSetting("XSECURELOCK_WATCHDOG_THRESHOLD_MS", 100);
+  memset(histogram, 0, sizeof(histogram));
+  slow_streak = 0;
+  gettimeofday(&last_ping, NULL);
+}
+
+void MaybePingXServer(Display* display) {
+  if (interval_ms <= 0 || MillisecondsSince(&last_ping) < interval_ms) {
+    return;
+  }
+  gettimeofday(&last_ping, NULL);
+  // XSync is a GetInputFocus request, which the server answers right away -
+  // unless it is busy with something else.
+  XSync(display, False);
+  double rtt_ms = MillisecondsSince(&last_ping);
+
+  int bucket = 0;
+  while (bucket < NUM_BUCKETS - 1 && rtt_ms >= (1 << bucket)) {
+    ++bucket;
+  }
+  ++histogram[bucket];
+
+  if (rtt_ms >= threshold_ms) {
+    if (slow_streak++ == 0) {
+      Log("X server is slow: round trip took %.1f ms", rtt_ms);
+    }
+  } else if (slow_streak > 0) {
+    Log("X server is responsive again after %d slow round trips", slow_streak);
+    slow_streak = 0;
+  }
+}
+
+void FormatXServerWatchdogHistogram(char* buf, size_t size) {
+  size_t len = 0;
+  buf[0] = 0;
+  for (int i = 0; i < NUM_BUCKETS && len < size; ++i) {
+    int n;
+    if (i < NUM_BUCKETS - 1) {
+      n = snprintf(buf + len, size - len, "%s<%dms:%lu", i ? " " : "", 1 << i,
+                   histogram[i]);
+    } else {
+      n = snprintf(buf + len, size - len, " >=%dms:%lu", 1 << (i - 1),
+                   histogram[i]);
+    }
+    if (n < 0) {
+      break;
+    }
+    len += n;
+  }
+}
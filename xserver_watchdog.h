@@ -0,0 +1,44 @@
+/*
+Copyright 2018 Google Inc. All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef XSERVER_WATCHDOG_H
+#define XSERVER_WATCHDOG_H
+
+#include <X11/Xlib.h>  // for Display
+#include <stddef.h>    // for size_t
+
+/*! \brief Reads the watchdog settings and resets its statistics.
+ */
+void InitXServerWatchdog(void);
+
+/*! \brief Measures the X server round trip time, if it is time to do so.
+ *
+ * Meant to be called from the main loop; it only actually does something every
+ * XSECURELOCK_WATCHDOG_INTERVAL_MS. Logs when the round trip time crosses
+ * XSECURELOCK_WATCHDOG_THRESHOLD_MS in either direction.
+ *
+ * \param display The X11 display.
+ */
+void MaybePingXServer(Display* display);
+
+/*! \brief Formats the histogram of round trip times measured so far.
+ *
+ * \param buf The buffer to write to; e.g. "<1ms:57 <2ms:3 ... >=512ms:0".
+ * \param size The size of the buffer.
+ */
+void FormatXServerWatchdogHistogram(char* buf, size_t size);
+
+#endif